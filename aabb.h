@@ -28,23 +28,51 @@ public:
     }
 
     bool hit(const ray& r, interval ray_t) const noexcept {
-        const auto& ray_orig = r.origin();
-        const auto& ray_dir = r.direction();
+        return hit(traversal_ray(r), ray_t);
+    }
 
+    bool hit(const traversal_ray& r, interval ray_t) const noexcept {
+        // Branchless slab test: the ray's signs pick the near and far plane per axis. The
+        // running bound is compared first so that a NaN distance (a ray lying in a slab plane,
+        // 0 * inf) leaves it unchanged and the ray counts as inside that slab.
         for (size_t axis = 0; axis < 3; ++axis) {
             const auto& ax = axis_interval(axis);
-            const auto adinv = 1.0 / ray_dir[axis];
+            auto near_plane = r.negative[axis] ? ax.max : ax.min;
+            auto far_plane = r.negative[axis] ? ax.min : ax.max;
+            auto t0 = (near_plane - r.origin[axis]) * r.inv_direction[axis];
+            auto t1 = (far_plane - r.origin[axis]) * r.inv_direction[axis];
+            ray_t.min = ray_t.min < t0 ? t0 : ray_t.min;
+            ray_t.max = ray_t.max > t1 ? t1 : ray_t.max;
+        }
+        return ray_t.min < ray_t.max;
+    }
+
+    // The overlap of two boxes. Axes that do not overlap come out inverted (min > max).
+    static aabb intersection(const aabb& a, const aabb& b) {
+        aabb result;
+        for (size_t i = 0; i < 3; ++i)
+            result.intervals[i] = interval(std::max(a.intervals[i].min, b.intervals[i].min),
+                                           std::min(a.intervals[i].max, b.intervals[i].max));
+        return result;
+    }
 
-            auto [t0, t1] = std::minmax((ax.min - ray_orig[axis]) * adinv,
-                (ax.max - ray_orig[axis]) * adinv);
+    bool is_empty() const {
+        return intervals[0].min > intervals[0].max || intervals[1].min > intervals[1].max
+            || intervals[2].min > intervals[2].max;
+    }
 
-            ray_t.min = std::max(t0, ray_t.min);
-            ray_t.max = std::min(t1, ray_t.max);
+    point3 centroid() const {
+        return point3(0.5 * (intervals[0].min + intervals[0].max),
+                      0.5 * (intervals[1].min + intervals[1].max),
+                      0.5 * (intervals[2].min + intervals[2].max));
+    }
 
-            if (ray_t.max <= ray_t.min)
-                return false;
-        }
-        return true;
+    double surface_area() const {
+        // Zero for empty boxes, so they add nothing to a surface area heuristic.
+        auto x = std::max(0.0, intervals[0].size());
+        auto y = std::max(0.0, intervals[1].size());
+        auto z = std::max(0.0, intervals[2].size());
+        return 2 * (x * y + y * z + z * x);
     }
 
     int longest_axis() const
@@ -0,0 +1,49 @@
+#include "rt.h"
+
+#include "camera.h"
+#include "scenes.h"
+
+#include <algorithm>
+#include <vector>
+
+// Regression test for adaptive sampling: renders the bouncing spheres at several budgets and
+// checks that the render stays within samples_per_pixel samples per pixel on average, that some
+// pixels converge and stop early, and that the samples they leave go to noisier pixels.
+//
+// Build: g++ -std=c++17 -O2 -pthread adaptive_test.cpp -o rt_adaptive_test
+// Usage: rt_adaptive_test   (exits with 1 if a budget is overrun or nothing adapts)
+
+int main() {
+    bool ok = true;
+
+    for (int spp : { 4, 10 }) {
+        seed_random(1);
+        scene s;
+        build_scene("bouncing_spheres", s);
+        s.cam.image_width = 80;
+        s.cam.samples_per_pixel = spp;
+        s.cam.adaptive_sampling = true;
+
+        std::vector<uint8_t> pixels(size_t(s.cam.image_width) * s.cam.image_height_pixels() * 3);
+        s.cam.render(s.world, pixels.data());
+
+        const auto& counts = s.cam.pixel_sample_counts();
+        size_t total = 0;
+        for (auto n : counts)
+            total += n;
+        double average = double(total) / counts.size();
+        auto fewest = *std::min_element(counts.begin(), counts.end());
+        auto most = *std::max_element(counts.begin(), counts.end());
+
+        // A pixel that took fewer samples than the budget stopped early; one that took more got
+        // the samples it left.
+        bool within_budget = average <= spp;
+        bool adapted = fewest < spp && most > spp;
+        std::clog << spp << " spp budget: " << average << " spp on average, " << fewest << " to " << most
+            << " per pixel" << (within_budget ? "" : ", over budget") << (adapted ? "" : ", not adapted") << '\n';
+        ok = ok && within_budget && adapted;
+    }
+
+    std::clog << (ok ? "PASS" : "FAIL") << '\n';
+    return ok ? 0 : 1;
+}
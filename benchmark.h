@@ -0,0 +1,116 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// A small harness in the style of Google Benchmark, so the benchmark targets build with nothing
+// but a C++17 compiler. Each benchmark is a batch function that makes a known number of calls
+// to the kernel under test and returns how many of them "succeeded" (hit, scattered, ...).
+// The harness picks how many batches to run so that each repetition takes at least min_time
+// seconds, and reports the median repetition.
+
+struct benchmark_result {
+    std::string name;
+    std::string unit;       // What one call processes, e.g. "rays"
+    uint64_t calls;         // Kernel calls per repetition
+    double ns_per_call;     // Median over the repetitions
+    double calls_per_second;
+    double success_rate;    // Fraction of calls that returned true
+};
+
+class benchmark_suite {
+public:
+    double min_time = 0.25;  // Minimum seconds per repetition
+    int repetitions = 3;
+    std::string filter;      // Only run benchmarks whose name contains this
+
+    bool enabled(const std::string& name) const {
+        return filter.empty() || name.find(filter) != std::string::npos;
+    }
+
+    void run(const std::string& name, size_t calls_per_batch, const std::string& unit,
+        const std::function<size_t()>& batch) {
+        if (!enabled(name) || calls_per_batch == 0)
+            return;
+
+        if (results_.empty())
+            print_header();
+
+        // Warm the caches, then size the repetition from one timed batch.
+        sink += batch();
+        auto batch_seconds = std::max(time([&] { sink += batch(); }), 1e-9);
+        auto batches = uint64_t(std::max(1.0, std::ceil(min_time / batch_seconds)));
+
+        std::vector<double> samples;
+        uint64_t successes = 0;
+        for (int rep = 0; rep < std::max(1, repetitions); rep++) {
+            size_t rep_successes = 0;
+            auto seconds = time([&] {
+                for (uint64_t b = 0; b < batches; b++)
+                    rep_successes += batch();
+            });
+            successes = rep_successes;
+            samples.push_back(seconds);
+        }
+        sink += successes;
+
+        std::sort(samples.begin(), samples.end());
+        auto seconds = samples[samples.size() / 2];
+        auto calls = batches * calls_per_batch;
+
+        benchmark_result result;
+        result.name = name;
+        result.unit = unit;
+        result.calls = calls;
+        result.ns_per_call = 1e9 * seconds / double(calls);
+        result.calls_per_second = double(calls) / seconds;
+        result.success_rate = double(successes) / double(calls);
+        results_.push_back(result);
+
+        print_row(result);
+    }
+
+    const std::vector<benchmark_result>& results() const { return results_; }
+
+private:
+    std::vector<benchmark_result> results_;
+    volatile size_t sink = 0;  // Keeps batch results observable so they cannot be optimized out
+
+    template <typename F>
+    static double time(F&& body) {
+        auto start = std::chrono::steady_clock::now();
+        body();
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    static void print_header() {
+        std::cout << std::string(92, '-') << '\n'
+                  << std::left << std::setw(40) << "Benchmark"
+                  << std::right << std::setw(12) << "Time/call"
+                  << std::setw(14) << "Calls"
+                  << std::setw(18) << "Throughput"
+                  << std::setw(8) << "Hits" << '\n'
+                  << std::string(92, '-') << '\n';
+    }
+
+    static void print_row(const benchmark_result& r) {
+        std::cout << std::left << std::setw(40) << r.name
+                  << std::right << std::fixed << std::setprecision(2)
+                  << std::setw(9) << r.ns_per_call << " ns"
+                  << std::setw(14) << r.calls
+                  << std::setw(9) << r.calls_per_second * 1e-6 << " M" << std::left << std::setw(8)
+                  << (r.unit + "/s") << std::right
+                  << std::setw(7) << std::setprecision(1) << 100.0 * r.success_rate << '%'
+                  << std::defaultfloat << std::endl;
+    }
+};
+
+#endif
@@ -4,77 +4,412 @@
 #include "rt.h"
 
 #include "aabb.h"
+#include "bvh_builder.h"
 #include "hittable.h"
 #include "hittable_list.h"
+#include "lbvh_builder.h"
+#include "primitive_store.h"
+#include "sbvh_builder.h"
+#include "thread_pool.h"
+#include "wide_bvh.h"
 
-class bvh_node : public hittable {
-public:
-    bvh_node(hittable_list list) : bvh_node(list.objects, 0, list.objects.size()) {}
+#include <chrono>
+#include <unordered_set>
+#include <vector>
 
-    bvh_node(const std::vector<shared_ptr<hittable>>& src_objects, size_t start, size_t end) {
-        auto objects = src_objects; // Local copy of the objects
-        bbox = aabb::empty;
+class bvh_tree {
+    // The nodes of a BVH and their traversal, apart from what the leaves hold: a leaf covers a
+    // range of an array the owner keeps in the leaf order build() leaves the references in.
+    // bvh_node keeps hittables there, triangle_mesh the packed triangles.
+public:
+    // Builds the tree with the builder options.split names; refs come back in leaf order.
+    // Spatial splits need split to cut a primitive's box at a plane; without one, sbvh builds
+    // a plain SAH tree. A parallel build runs on workers if given, else on a pool started for
+    // it.
+    void build(std::vector<bvh_prim_ref>& refs, const bvh_build_options& options,
+        const sbvh_builder::split_function& split = {}, thread_pool* workers = nullptr) {
+        if (options.split == bvh_split::lbvh)
+            nodes = lbvh_builder(refs, options, workers).build();
+        else if (options.split == bvh_split::sbvh && split)
+            nodes = sbvh_builder(refs, split, options).build();
+        else
+            nodes = bvh_builder(refs, options, workers).build();
 
-        for (size_t object_index = start; object_index < end; object_index++)
-            bbox = aabb(bbox, objects[object_index]->bounding_box());
+        wide_width = options.width;
+        collapse_wide();
+    }
 
-        int axis = bbox.longest_axis();
-        const auto comparator = [axis](const auto& a, const auto& b) {
-            return box_compare(a, b, axis);
-            };
+    double refit(const std::vector<aabb>& boxes, double traversal_cost) {
+        // Recomputes every node box from the current boxes of the leaf-ordered primitives and
+        // returns the new SAH cost. Nodes are stored depth-first, so children always come after
+        // their parent and one backwards sweep reaches every child before its parent.
+        double weighted_area = 0;
+        for (size_t index = nodes.size(); index-- > 0;) {
+            auto& node = nodes[index];
+            if (node.primitive_count > 0) {
+                aabb box = boxes[node.offset];
+                for (uint32_t i = node.offset + 1; i < node.offset + node.primitive_count; i++)
+                    box = aabb(box, boxes[i]);
+                for (int axis = 0; axis < 3; axis++) {
+                    node.bounds_min[axis] = bvh_builder::round_down(box.axis_interval(axis).min);
+                    node.bounds_max[axis] = bvh_builder::round_up(box.axis_interval(axis).max);
+                }
+                weighted_area += node_box(node).surface_area() * node.primitive_count;
+            }
+            else {
+                const auto& left = nodes[index + 1];
+                const auto& right = nodes[node.offset];
+                for (int axis = 0; axis < 3; axis++) {
+                    node.bounds_min[axis] = std::min(left.bounds_min[axis], right.bounds_min[axis]);
+                    node.bounds_max[axis] = std::max(left.bounds_max[axis], right.bounds_max[axis]);
+                }
+                weighted_area += node_box(node).surface_area() * traversal_cost;
+            }
+        }
+        collapse_wide();
 
-        size_t object_span = end - start;
+        auto root_area = node_box(nodes[0]).surface_area();
+        return root_area > 0 ? weighted_area / root_area : 0.0;
+    }
 
-        if (object_span == 1) {
-            left = right = objects[start];
+    // Visits the leaves the ray may hit within ray_t, nearest first. visit_leaf(first, count,
+    // ray_t) tests primitives [first, first + count), may shrink ray_t.max, and returns true to
+    // end the traversal early.
+    template <typename Leaf>
+    void traverse(const ray& r, interval& ray_t, Leaf&& visit_leaf) const {
+        const traversal_ray traversal(r);
+        if (!nodes4.empty()) {
+            nodes4.traverse(traversal, ray_t, visit_leaf);
+            return;
         }
-        else if (object_span == 2) {
-            if (comparator(objects[start], objects[start + 1])) {
-                left = objects[start];
-                right = objects[start + 1];
-            }
-            else {
-                left = objects[start + 1];
-                right = objects[start];
+        if (!nodes8.empty()) {
+            nodes8.traverse(traversal, ray_t, visit_leaf);
+            return;
+        }
+        if (nodes.empty())
+            return;
+
+        uint32_t stack[stack_size];
+        int stack_top = 0;
+        uint32_t index = 0;
+
+        while (true) {
+            const auto& node = nodes[index];
+
+            if (node_hit(node, traversal, ray_t)) {
+                if (node.primitive_count > 0) {
+                    if (visit_leaf(node.offset, uint32_t(node.primitive_count), ray_t))
+                        return;
+                }
+                else {
+                    // Visit the child on the near side of the split first, so the far one is
+                    // more likely to be culled by the closer hit.
+                    if (traversal.negative[node.axis]) {
+                        stack[stack_top++] = index + 1;
+                        index = node.offset;
+                    }
+                    else {
+                        stack[stack_top++] = node.offset;
+                        index = index + 1;
+                    }
+                    continue;
+                }
             }
+
+            if (stack_top == 0)
+                break;
+            index = stack[--stack_top];
         }
-        else {
-            // Used nth_element better performance we dont need to sort the whole list
-            std::nth_element(objects.begin() + start,
-                objects.begin() + start + object_span / 2,
-                objects.begin() + end, comparator);
-
-            auto mid = start + object_span / 2;
-            left = make_shared<bvh_node>(objects, start, mid);
-            right = make_shared<bvh_node>(objects, mid, end);
+    }
+
+    bvh_stats stats(double traversal_cost = 1.0) const {
+        // Sums the surface area heuristic over the tree: a node is visited with probability
+        // area(node) / area(root) by a ray that hits the root, costing traversal_cost per
+        // interior node and one unit per primitive tested in a leaf.
+        bvh_stats result;
+        if (!nodes.empty())
+            accumulate_stats(result, 0, traversal_cost, node_box(nodes[0]).surface_area(), 1);
+        return result;
+    }
+
+    bool empty() const { return nodes.empty(); }
+    size_t node_count() const { return nodes.size(); }
+
+    // Children per traversal node: 2, 4 or 8.
+    int width() const { return !nodes4.empty() ? 4 : !nodes8.empty() ? 8 : 2; }
+
+    // Bytes held by the node arrays.
+    size_t memory_bytes() const {
+        return nodes.capacity() * sizeof(flat_bvh_node) + nodes4.node_count() * sizeof(wide_bvh_node<4>)
+            + nodes8.node_count() * sizeof(wide_bvh_node<8>);
+    }
+
+private:
+    // Deep enough for any tree the builders make: past max_sah_depth bvh_builder only splits at
+    // the median, which adds at most one level per halving of a 32-bit primitive count, and an
+    // LBVH is at most one level per bit of its 30-bit code and 32-bit tie-breaking index.
+    static constexpr int stack_size = bvh_builder::max_sah_depth + 64;
+
+    std::vector<flat_bvh_node> nodes;  // Depth-first, root first
+    wide_bvh<4> nodes4;                // Built when the width is 4
+    wide_bvh<8> nodes8;                // Built when the width is 8
+    int wide_width = 2;
+
+    void collapse_wide() {
+        // A wide tree is collapsed from the binary one, which stays around for the stats and
+        // for refitting.
+        if (wide_width == 4)
+            nodes4 = wide_bvh<4>(nodes);
+        else if (wide_width == 8)
+            nodes8 = wide_bvh<8>(nodes);
+    }
+
+    static bool node_hit(const flat_bvh_node& node, const traversal_ray& r, interval ray_t) {
+        // Branchless slab test against the node box, the ray's signs indexing the near and far
+        // planes. A zero direction component gives an infinite inverse and a NaN distance when
+        // the origin lies on the plane; the running bound is compared first, so the NaN leaves
+        // the interval unchanged and the ray counts as inside that slab.
+        const float* planes[2] = { node.bounds_min, node.bounds_max };
+        for (int axis = 0; axis < 3; axis++) {
+            auto t0 = (planes[r.negative[axis]][axis] - r.origin[axis]) * r.inv_direction[axis];
+            auto t1 = (planes[1 - r.negative[axis]][axis] - r.origin[axis]) * r.inv_direction[axis];
+            ray_t.min = ray_t.min < t0 ? t0 : ray_t.min;
+            ray_t.max = ray_t.max > t1 ? t1 : ray_t.max;
         }
+        return ray_t.min < ray_t.max;
+    }
 
-        bbox = aabb(left->bounding_box(), right->bounding_box());
+    static aabb node_box(const flat_bvh_node& node) {
+        return aabb(interval(node.bounds_min[0], node.bounds_max[0]),
+                    interval(node.bounds_min[1], node.bounds_max[1]),
+                    interval(node.bounds_min[2], node.bounds_max[2]));
     }
 
+    void accumulate_stats(bvh_stats& result, uint32_t index, double traversal_cost, double root_area,
+        int depth) const {
+        const auto& node = nodes[index];
+        auto probability = root_area > 0 ? node_box(node).surface_area() / root_area : 1.0;
+        result.max_depth = std::max(result.max_depth, depth);
+
+        if (node.primitive_count > 0) {
+            result.leaves++;
+            result.primitives += node.primitive_count;
+            result.sah_cost += probability * node.primitive_count;
+            return;
+        }
+
+        result.interior_nodes++;
+        result.sah_cost += probability * traversal_cost;
+        accumulate_stats(result, index + 1, traversal_cost, root_area, depth + 1);
+        accumulate_stats(result, node.offset, traversal_cost, root_area, depth + 1);
+    }
+};
+
+class bvh_node : public hittable {
+public:
+    bvh_node(hittable_list list, const bvh_build_options& options = {})
+        : bvh_node(list.objects, 0, list.objects.size(), options) {}
+
+    bvh_node(const std::vector<shared_ptr<hittable>>& src_objects, size_t start, size_t end,
+        const bvh_build_options& options = {})
+        : primitives(src_objects.begin() + start, src_objects.begin() + end), options(options),
+          object_count(primitives.size()) {
+        build();
+    }
 
     bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
-        if (!bbox.hit(r, ray_t))
-            return false;
+        return two_phase_hit(r, ray_t, rec);
+    }
 
-        bool hit_left = left->hit(r, ray_t, rec);
-        bool hit_right = right->hit(r, interval(ray_t.min, hit_left ? rec.t : ray_t.max), rec);
+    bool intersect(const ray& r, interval ray_t, hit_record& rec) const override {
+        // Only distances are compared during traversal; the closest primitive fills in the
+        // rest of the record afterwards.
+        bool hit_anything = false;
+        tree.traverse(r, ray_t, [&](uint32_t first, uint32_t count, interval& leaf_t) {
+            for (uint32_t i = first; i < first + count; i++) {
+                if (store.intersect(i, r, leaf_t, rec)) {
+                    hit_anything = true;
+                    leaf_t.max = rec.t;
+                }
+            }
+            return false;
+        });
+        return hit_anything;
+    }
 
-        return hit_left || hit_right;
+    bool occluded(const ray& r, interval ray_t) const override {
+        // The first primitive found within ray_t ends the traversal, and no record is written.
+        bool blocked = false;
+        tree.traverse(r, ray_t, [&](uint32_t first, uint32_t count, interval& leaf_t) {
+            for (uint32_t i = first; i < first + count; i++) {
+                if (store.occluded(i, r, leaf_t))
+                    return blocked = true;
+            }
+            return false;
+        });
+        return blocked;
     }
 
     aabb bounding_box() const override { return bbox; }
 
-    void update(double time) override {};
+    void update(double time) override {
+        // Moves the primitives to the given time and refits the tree's boxes around them. A
+        // refit keeps the old topology, which gets worse as primitives drift apart, so once the
+        // SAH cost has grown past rebuild_threshold times its value after the last build the
+        // tree is rebuilt instead.
+        auto start = std::chrono::steady_clock::now();
+        if (primitives.size() > object_count) {
+            // A spatial-split build lists some primitives twice; each still moves only once.
+            std::unordered_set<const hittable*> seen;
+            seen.reserve(object_count);
+            for (const auto& object : primitives) {
+                if (seen.insert(object.get()).second)
+                    object->update(time);
+            }
+        }
+        else {
+            for (const auto& object : primitives)
+                object->update(time);
+        }
+        store.refresh();
+
+        update_rebuilt = options.rebuild_threshold <= 0 || tree.empty()
+            || refit() > built_cost * options.rebuild_threshold;
+        if (update_rebuilt)
+            build(update_workers());
+
+        last_update_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    const bvh_build_options& build_options() const { return options; }
+
+    // Wall time of the most recent full build.
+    double build_seconds() const { return last_build_seconds; }
+
+    // Wall time of the most recent update(), and whether it rebuilt rather than refit the tree.
+    double update_seconds() const { return last_update_seconds; }
+    bool rebuilt_on_update() const { return update_rebuilt; }
+
+    // SAH cost of the tree as it is now, and as it was right after the last full build.
+    double sah_cost() const { return current_cost; }
+    double built_sah_cost() const { return built_cost; }
+
+    bvh_stats stats(double traversal_cost = 1.0) const { return tree.stats(traversal_cost); }
+    size_t node_count() const { return tree.node_count(); }
+    int width() const { return tree.width(); }
+    const primitive_store& leaf_primitives() const { return store; }
 
 private:
-    shared_ptr<hittable> left;
-    shared_ptr<hittable> right;
+    static constexpr size_t min_parallel_refit = 1 << 15;  // Fewer primitives are refit serially
+    static constexpr size_t min_parallel_build =   // No builder runs in parallel below this
+        std::min(2 * bvh_builder::min_task_size, lbvh_builder::min_parallel_size);
+
+    bvh_tree tree;
+    std::vector<shared_ptr<hittable>> primitives; // Leaf primitives, contiguous per leaf
+    primitive_store store;     // The same primitives by type, as traversal tests them
+    bvh_build_options options;
+    size_t object_count;       // Distinct primitives; a spatial-split build lists some twice
     aabb bbox;
+    double built_cost = 0;     // SAH cost right after the last full build
+    double current_cost = 0;   // SAH cost after the last build or refit
+    double last_build_seconds = 0;
+    double last_update_seconds = 0;
+    bool update_rebuilt = false;
+    std::unique_ptr<thread_pool> update_pool;  // Refit and rebuild workers, kept alive across updates
+
+    void build(thread_pool* workers = nullptr) {
+        auto start = std::chrono::steady_clock::now();
+
+        if (primitives.size() > object_count)
+            remove_duplicates();
+
+        // Each primitive's box is fetched once; the builder then only moves references.
+        std::vector<bvh_prim_ref> refs(primitives.size());
+        bbox = aabb::empty;
+        for (size_t i = 0; i < refs.size(); i++) {
+            auto box = primitives[i]->bounding_box();
+            refs[i] = { box, box.centroid(), uint32_t(i) };
+            bbox = i == 0 ? box : aabb(bbox, box);
+        }
+
+        tree.build(refs, options, [this](uint32_t index, const aabb& box, int axis, double position,
+            aabb& left, aabb& right) {
+            primitives[index]->split_box(box, axis, position, left, right);
+        }, workers);
+
+        // Only a spatial-split build can reference a primitive twice; the others move them.
+        bool shared_leaves = refs.size() > object_count;
+        std::vector<shared_ptr<hittable>> ordered;
+        ordered.reserve(refs.size());
+        for (const auto& ref : refs) {
+            if (shared_leaves)
+                ordered.push_back(primitives[ref.index]);
+            else
+                ordered.push_back(std::move(primitives[ref.index]));
+        }
+        primitives.swap(ordered);
+        store.assign(primitives);
+
+        built_cost = current_cost = stats(options.traversal_cost).sah_cost;
+
+        last_build_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void remove_duplicates() {
+        // Undoes the duplication of a spatial-split build before rebuilding, keeping the first
+        // reference to every primitive.
+        std::unordered_set<const hittable*> seen;
+        seen.reserve(object_count);
+        std::vector<shared_ptr<hittable>> unique;
+        unique.reserve(object_count);
+        for (auto& object : primitives) {
+            if (seen.insert(object.get()).second)
+                unique.push_back(std::move(object));
+        }
+        primitives.swap(unique);
+    }
+
+    double refit() {
+        // Refits the tree around the primitives' current boxes and returns the new SAH cost.
+        // Fetching the boxes (a virtual call each) is the expensive part, so that is what runs
+        // in parallel.
+        std::vector<aabb> boxes(primitives.size());
+        auto fetch = [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+                boxes[i] = primitives[i]->bounding_box();
+        };
+
+        auto workers = boxes.size() >= min_parallel_refit ? update_workers() : nullptr;
+        if (workers) {
+            size_t chunks = 4 * size_t(workers->thread_count());
+            workers->parallel_for(chunks, [&](size_t chunk, int) {
+                fetch(chunk * boxes.size() / chunks, (chunk + 1) * boxes.size() / chunks);
+            });
+        }
+        else {
+            fetch(0, boxes.size());
+        }
+
+        bbox = boxes[0];
+        for (const auto& box : boxes)
+            bbox = aabb(bbox, box);
+
+        current_cost = tree.refit(boxes, options.traversal_cost);
+        return current_cost;
+    }
 
-    static bool box_compare(const shared_ptr<hittable>& a, const shared_ptr<hittable>& b, int axis) {
-        return a->bounding_box().axis_interval(axis).min < b->bounding_box().axis_interval(axis).min;
+    thread_pool* update_workers() {
+        // The pool update()'s refits and rebuilds run on: started by the first update and kept
+        // for the later ones, as camera keeps its tile workers across frames, so an animated
+        // scene does not start and join every worker each frame. Null when the tree is too
+        // small for either to run in parallel. The build in the constructor starts its own.
+        int threads = options.build_threads > 0 ? options.build_threads : thread_pool::default_thread_count();
+        if (threads <= 1 || primitives.size() < min_parallel_build)
+            return nullptr;
+        if (!update_pool || update_pool->thread_count() != threads)
+            update_pool = std::make_unique<thread_pool>(threads);
+        return update_pool.get();
     }
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,399 @@
+#ifndef BVH_BUILDER_H
+#define BVH_BUILDER_H
+
+#include "rt.h"
+
+#include "aabb.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <string>
+#include <vector>
+
+enum class bvh_split {
+    automatic,  // sah, or lbvh for an animated scene (resolved by build_scene)
+    median,     // Object median along the longest axis (the original builder)
+    sah,        // Binned surface area heuristic
+    lbvh,       // Morton-ordered linear BVH: a lower quality tree that is fast to rebuild
+    sbvh        // SAH with spatial splits, which clip straddling primitives: slow to build, for
+                // static meshes with long or overlapping triangles
+};
+
+struct bvh_build_options {
+    bvh_split split = bvh_split::automatic;
+    int    bin_count = 16;          // Centroid bins per axis; bin_count - 1 candidate planes
+    int    max_leaf_size = 4;       // Spans at most this large may become leaves
+    double traversal_cost = 1.0;    // Cost of visiting a node, relative to one primitive test
+    int    build_threads = 0;       // Threads building subtrees (0 = hardware concurrency, 1 = serial)
+    int    width = 2;               // Children per traversal node: 2, or 4 / 8 for a wide BVH
+    double rebuild_threshold = 1.5; // bvh_node::update refits until the SAH cost grows past this
+                                    // multiple of its value after the last build (0 = always rebuild)
+    double split_budget = 1.0;      // sbvh: extra leaf references spatial splits may add, as a
+                                    // fraction of the primitive count
+};
+
+struct bvh_stats {
+    size_t interior_nodes = 0;
+    size_t leaves = 0;
+    size_t primitives = 0;
+    int    max_depth = 0;
+    double sah_cost = 0;  // Expected cost of a ray hitting the root box, in primitive tests
+};
+
+inline bool parse_bvh_split(const std::string& name, bvh_split& split) {
+    if (name == "auto")
+        split = bvh_split::automatic;
+    else if (name == "median")
+        split = bvh_split::median;
+    else if (name == "sah")
+        split = bvh_split::sah;
+    else if (name == "lbvh")
+        split = bvh_split::lbvh;
+    else if (name == "sbvh")
+        split = bvh_split::sbvh;
+    else
+        return false;
+    return true;
+}
+
+inline const char* bvh_split_name(bvh_split split) {
+    switch (split) {
+    case bvh_split::median: return "median";
+    case bvh_split::sah:    return "sah";
+    case bvh_split::lbvh:   return "lbvh";
+    case bvh_split::sbvh:   return "sbvh";
+    default:                return "auto";
+    }
+}
+
+struct flat_bvh_node {
+    // One node of the flattened tree, 32 bytes so two share a cache line. The bounds are the
+    // double-precision box rounded outwards to float. The first child of an interior node
+    // directly follows it in the array, so only the second child's index is stored.
+    float    bounds_min[3];
+    float    bounds_max[3];
+    uint32_t offset;           // Interior: index of the second child. Leaf: first primitive.
+    uint16_t primitive_count;  // Zero for interior nodes
+    uint16_t axis;             // Split axis of an interior node, for front-to-back traversal
+};
+
+static_assert(sizeof(flat_bvh_node) == 32, "flat_bvh_node should stay 32 bytes");
+
+struct bvh_prim_ref {
+    // What the builder needs to know about one primitive, computed once up front so that the
+    // build never calls back into the primitives.
+    aabb     box;
+    point3   centroid;
+    uint32_t index;  // Position of the primitive in the caller's array
+};
+
+struct bvh_bin {
+    // Bounds and number of the references in a builder's bin. Kept as plain arrays so the bins
+    // need no construction; the bounds are only meaningful once count is non-zero.
+    double low[3], high[3];
+    size_t count;
+
+    void add(const aabb& box) {
+        for (int axis = 0; axis < 3; axis++) {
+            const auto& extent = box.axis_interval(axis);
+            low[axis] = count ? std::min(low[axis], extent.min) : extent.min;
+            high[axis] = count ? std::max(high[axis], extent.max) : extent.max;
+        }
+        count++;
+    }
+
+    void add(const bvh_bin& other) {
+        for (int axis = 0; axis < 3; axis++) {
+            low[axis] = count ? std::min(low[axis], other.low[axis]) : other.low[axis];
+            high[axis] = count ? std::max(high[axis], other.high[axis]) : other.high[axis];
+        }
+        count += other.count;
+    }
+
+    void add(const point3& p) {
+        for (int axis = 0; axis < 3; axis++) {
+            low[axis] = count ? std::min(low[axis], p[axis]) : p[axis];
+            high[axis] = count ? std::max(high[axis], p[axis]) : p[axis];
+        }
+        count++;
+    }
+
+    aabb box() const {
+        return aabb(interval(low[0], high[0]), interval(low[1], high[1]), interval(low[2], high[2]));
+    }
+
+    double area() const {
+        auto x = high[0] - low[0], y = high[1] - low[1], z = high[2] - low[2];
+        return 2 * (x * y + y * z + z * x);
+    }
+};
+
+class bvh_builder {
+    // Builds a flattened BVH over an array of primitive references, partitioning that one
+    // array in place. Nodes are written into a buffer with room for the largest possible tree
+    // (2n - 1 nodes): the node for a span of n references owns the next 2n - 1 slots, its first
+    // child starts right after it and its second child 2 * (first child's span) slots later.
+    // That makes the slot of every subtree known before its siblings are built, so large
+    // subtrees are built as independent tasks on a thread pool. A final pass packs the nodes,
+    // removing the slots left free by multi-primitive leaves.
+public:
+    static constexpr int max_bins = 64;
+    static constexpr int max_sah_depth = 64;  // Deeper nodes split at the median only
+    static constexpr size_t min_task_size = 4096;  // Smallest span built as a separate task
+
+    // The subtree tasks run on workers if given, else on a pool of its own for the one build.
+    bvh_builder(std::vector<bvh_prim_ref>& refs, const bvh_build_options& options,
+        thread_pool* workers = nullptr)
+        : refs(refs), options(options), workers(workers) {}
+
+    // Builds the tree. On return refs is in leaf order: leaf primitives are refs[offset ..
+    // offset + primitive_count), and refs[i].index maps back to the caller's primitive.
+    std::vector<flat_bvh_node> build() {
+        std::vector<flat_bvh_node> nodes;
+        if (refs.empty())
+            return nodes;
+
+        slots.assign(2 * refs.size() - 1, flat_bvh_node{});
+
+        int threads = options.build_threads > 0 ? options.build_threads : thread_pool::default_thread_count();
+        if (threads > 1 && refs.size() >= 2 * min_task_size) {
+            // Build the top of the tree here, collecting subtrees of a few thousand primitives
+            // as tasks, then hand the tasks to the pool largest first.
+            task_size = std::max(min_task_size, refs.size() / (8 * size_t(threads)));
+            build_node(0, 0, refs.size(), 1, true);
+
+            std::sort(tasks.begin(), tasks.end(), [](const subtree& a, const subtree& b) {
+                return a.end - a.start > b.end - b.start;
+            });
+            std::unique_ptr<thread_pool> own_pool;
+            if (!workers) {
+                own_pool = std::make_unique<thread_pool>(threads);
+                workers = own_pool.get();
+            }
+            workers->parallel_for(tasks.size(), [&](size_t index, int) {
+                const auto& task = tasks[index];
+                build_node(task.slot, task.start, task.end, task.depth, false);
+            });
+        }
+        else {
+            build_node(0, 0, refs.size(), 1, false);
+        }
+
+        return pack();
+    }
+
+    // Node bounds are stored as floats rounded outwards, so they still contain the double box.
+    static float round_down(double x) {
+        auto f = float(x);
+        return double(f) > x ? std::nextafter(f, -std::numeric_limits<float>::infinity()) : f;
+    }
+
+    static float round_up(double x) {
+        auto f = float(x);
+        return double(f) < x ? std::nextafter(f, std::numeric_limits<float>::infinity()) : f;
+    }
+
+private:
+    struct subtree {
+        uint32_t slot;
+        size_t start, end;
+        int depth;
+    };
+
+    std::vector<bvh_prim_ref>& refs;
+    bvh_build_options options;
+    thread_pool* workers;              // Pool for the subtree tasks, if the caller keeps one
+    std::vector<flat_bvh_node> slots;  // Unpacked nodes, indexed as described above
+    std::vector<subtree> tasks;
+    size_t task_size = 0;
+
+    void build_node(uint32_t slot, size_t start, size_t end, int depth, bool collect_tasks) {
+        if (collect_tasks && end - start <= task_size) {
+            tasks.push_back({ slot, start, end, depth });
+            return;
+        }
+
+        bvh_bin box_bin, centroid_bin;
+        box_bin.count = centroid_bin.count = 0;
+        for (size_t i = start; i < end; i++) {
+            box_bin.add(refs[i].box);
+            centroid_bin.add(refs[i].centroid);
+        }
+        auto bounds = box_bin.box();
+        auto centroid_bounds = centroid_bin.box();
+
+        auto& node = slots[slot];
+        for (int axis = 0; axis < 3; axis++) {
+            node.bounds_min[axis] = round_down(bounds.axis_interval(axis).min);
+            node.bounds_max[axis] = round_up(bounds.axis_interval(axis).max);
+        }
+
+        size_t object_span = end - start;
+        size_t leaf_limit = size_t(std::clamp(options.max_leaf_size, 1, 0xffff));
+        size_t mid = start;
+        int axis = bounds.longest_axis();
+
+        if (options.split != bvh_split::median && object_span > 1 && depth < max_sah_depth)
+            mid = sah_partition(start, end, bounds, centroid_bounds, axis);
+        else if (object_span > leaf_limit)
+            mid = median_partition(start, end, axis);
+
+        if (mid == start || mid == end) {
+            if (object_span <= leaf_limit) {
+                node.offset = uint32_t(start);
+                node.primitive_count = uint16_t(object_span);
+                return;
+            }
+            // No useful plane (for example every centroid coincides) but too many objects for
+            // one leaf: fall back to splitting at the object median.
+            axis = bounds.longest_axis();
+            mid = median_partition(start, end, axis);
+        }
+
+        auto second = uint32_t(slot + 2 * (mid - start));
+        node.offset = second;
+        node.primitive_count = 0;
+        node.axis = uint16_t(axis);
+
+        build_node(slot + 1, start, mid, depth + 1, collect_tasks);
+        build_node(second, mid, end, depth + 1, collect_tasks);
+    }
+
+    size_t median_partition(size_t start, size_t end, int axis) {
+        // Used nth_element better performance we dont need to sort the whole list
+        auto mid = start + (end - start) / 2;
+        std::nth_element(refs.begin() + start, refs.begin() + mid, refs.begin() + end,
+            [axis](const bvh_prim_ref& a, const bvh_prim_ref& b) {
+                return a.box.axis_interval(axis).min < b.box.axis_interval(axis).min;
+            });
+        return mid;
+    }
+
+    size_t sah_partition(size_t start, size_t end, const aabb& bounds, const aabb& centroid_bounds,
+        int& split_axis) {
+        // Drops every centroid into one of bin_count equal slices per axis and evaluates the
+        // bin_count - 1 planes between slices with the surface area heuristic. Returns the
+        // partition point, or start if keeping the span as a leaf is cheaper (or no plane
+        // separates the centroids).
+        int bin_count = std::clamp(options.bin_count, 2, max_bins);
+        std::array<std::array<bvh_bin, max_bins>, 3> bins;  // Only the first bin_count are used
+        std::array<double, max_bins> right_areas;
+        std::array<double, 3> scales;
+
+        size_t object_span = end - start;
+        double best_cost = infinity;
+        int best_axis = -1, best_plane = 0;
+
+        // Bin all three axes in one pass over the references.
+        for (int axis = 0; axis < 3; axis++) {
+            const auto& extent = centroid_bounds.axis_interval(axis);
+            scales[axis] = extent.size() > 0 ? bin_count / extent.size() : 0.0;
+            for (int b = 0; b < bin_count; b++)
+                bins[axis][b].count = 0;
+        }
+        for (size_t i = start; i < end; i++) {
+            for (int axis = 0; axis < 3; axis++) {
+                auto index = bin_index(refs[i].centroid[axis], centroid_bounds.axis_interval(axis).min,
+                    scales[axis], bin_count);
+                bins[axis][index].add(refs[i].box);
+            }
+        }
+
+        for (int axis = 0; axis < 3; axis++) {
+            if (scales[axis] == 0)
+                continue;
+            const auto& axis_bins = bins[axis];
+
+            // Sweep from the right to get the area right of every plane, then from the left to
+            // evaluate each plane. Planes next to an empty bin repeat their neighbour's split,
+            // so only the planes just past a non-empty bin are evaluated.
+            bvh_bin right;
+            right.count = 0;
+            for (int plane = bin_count - 1; plane > 0; plane--) {
+                if (axis_bins[plane].count) {
+                    right.add(axis_bins[plane]);
+                    right_areas[plane] = right.area();
+                }
+                else if (plane < bin_count - 1) {
+                    right_areas[plane] = right_areas[plane + 1];
+                }
+            }
+
+            bvh_bin left;
+            left.count = 0;
+            for (int plane = 1; plane < bin_count; plane++) {
+                if (axis_bins[plane - 1].count == 0)
+                    continue;
+                left.add(axis_bins[plane - 1]);
+                if (left.count == object_span)
+                    break;
+
+                auto cost = left.area() * left.count + right_areas[plane] * (object_span - left.count);
+                if (cost < best_cost) {
+                    best_cost = cost;
+                    best_axis = axis;
+                    best_plane = plane;
+                }
+            }
+        }
+
+        if (best_axis < 0)
+            return start;
+        split_axis = best_axis;
+
+        // Compare against making this span a leaf, with both costs in units of area(node).
+        auto node_area = bounds.surface_area();
+        auto split_cost = options.traversal_cost + (node_area > 0 ? best_cost / node_area : 0.0);
+        if (object_span <= size_t(std::max(options.max_leaf_size, 1)) && double(object_span) <= split_cost)
+            return start;
+
+        const auto& extent = centroid_bounds.axis_interval(best_axis);
+        auto scale = bin_count / extent.size();
+        auto middle = std::partition(refs.begin() + start, refs.begin() + end,
+            [&](const bvh_prim_ref& ref) {
+                return bin_index(ref.centroid[best_axis], extent.min, scale, bin_count) < best_plane;
+            });
+        return size_t(middle - refs.begin());
+    }
+
+    static int bin_index(double centroid, double min, double scale, int bin_count) {
+        return std::clamp(int((centroid - min) * scale), 0, bin_count - 1);
+    }
+
+    std::vector<flat_bvh_node> pack() const {
+        // Slots are in depth-first order with gaps, so walking the tree depth-first visits them
+        // in increasing order: the first pass numbers the used slots, the second copies them
+        // and rewrites second-child indices.
+        std::vector<uint32_t> packed_index(slots.size());
+        uint32_t count = 0;
+        std::vector<uint32_t> stack = { 0 };
+        while (!stack.empty()) {
+            auto slot = stack.back();
+            stack.pop_back();
+            packed_index[slot] = count++;
+            if (slots[slot].primitive_count == 0) {
+                stack.push_back(slots[slot].offset);
+                stack.push_back(slot + 1);
+            }
+        }
+
+        std::vector<flat_bvh_node> nodes(count);
+        stack.push_back(0);
+        while (!stack.empty()) {
+            auto slot = stack.back();
+            stack.pop_back();
+            auto& node = nodes[packed_index[slot]];
+            node = slots[slot];
+            if (node.primitive_count == 0) {
+                node.offset = packed_index[node.offset];
+                stack.push_back(slots[slot].offset);
+                stack.push_back(slot + 1);
+            }
+        }
+        return nodes;
+    }
+};
+
+#endif
@@ -0,0 +1,127 @@
+#include "rt.h"
+
+#include "camera.h"
+#include "scenes.h"
+
+#include <string>
+#include <vector>
+
+// Regression test for animated BVHs: renders the first frames of an animated scene with every
+// BVH builder, refitting and rebuilding, and checks each frame against the SAH build pixel for
+// pixel. The builders organize the tree differently, but every frame must see the same scene;
+// a primitive that a spatial-split build lists twice, for instance, must still be moved once
+// per frame.
+//
+// Build: g++ -std=c++17 -O2 -pthread bvh_test.cpp -o rt_bvh_test
+// Usage: rt_bvh_test   (exits with 1 if any frame differs)
+
+class drifting_triangle : public hittable {
+    // A triangle that moves by a fixed step on every update(), however far apart the times, as
+    // rotating_sphere turns from wherever it is. Updating it twice in a frame moves it twice.
+public:
+    drifting_triangle(const point3& a, const point3& b, const point3& c, const vec3& step, material_id mat)
+        : a(a), b(b), c(c), step(step), mat(mat) {}
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        double t;
+        if (!intersect_triangle(a, b - a, c - a, r, ray_t, t))
+            return false;
+        rec.t = t;
+        rec.p = r.rayPos(t);
+        rec.set_face_normal(r, unit_vector(cross(b - a, c - a)));
+        rec.u = rec.v = 0;
+        rec.mat = mat;
+        return true;
+    }
+
+    aabb bounding_box() const override { return triangle_box(a, b, c); }
+
+    void split_box(const aabb& box, int axis, double position, aabb& left, aabb& right) const override {
+        split_triangle_box(a, b, c, box, axis, position, left, right);
+    }
+
+    void update(double /*time*/) override {
+        a += step;
+        b += step;
+        c += step;
+    }
+
+private:
+    point3 a, b, c;
+    vec3 step;
+    material_id mat;
+};
+
+void drifting_scene(scene& s) {
+    // Long, thin triangles crossing each other, which the spatial-split builder does split,
+    // among a few orbiting spheres.
+    auto gray = s.materials->add(make_shared<lambertian>(color(0.5, 0.5, 0.5)));
+    auto shiny = s.materials->add(make_shared<metal>(color(0.8, 0.7, 0.6), 0.1));
+    for (int n = 0; n < 300; n++) {
+        auto center = 3 * vec3::random(-1, 1);
+        auto along = 3 * unit_vector(vec3::random(-1, 1));
+        auto across = 0.05 * unit_vector(cross(along, vec3::random(-1, 1)));
+        s.world.add(make_shared<drifting_triangle>(center - along, center + along, center + across,
+            0.1 * vec3::random(-1, 1), n % 3 ? gray : shiny));
+    }
+    for (int n = 0; n < 30; n++) {
+        auto ball = make_shared<sphere>(4 * vec3::random(-1, 1), 0.4, shiny);
+        s.world.add(make_shared<rotating_sphere>(ball, random_double(5, 40)));
+    }
+    s.animated = true;
+
+    camera& cam = s.cam;
+    cam.aspect_ratio = 1.0;
+    cam.image_width = 64;
+    cam.samples_per_pixel = 2;
+    cam.max_depth = 8;
+    cam.vfov = 50;
+    cam.lookfrom = point3(0, 6, 10);
+    cam.lookat = point3(0, 0, 0);
+    cam.total_frames = 4;
+}
+
+std::vector<std::vector<uint8_t>> render_frames(bvh_split split, double rebuild_threshold, size_t& references, size_t& primitives) {
+    seed_random(1);
+    scene s;
+    drifting_scene(s);
+
+    // What build_scene does once a builder has filled the scene.
+    s.bvh_options.split = split;
+    s.bvh_options.rebuild_threshold = rebuild_threshold;
+    primitives = s.world.objects.size();
+    s.bvh = make_shared<bvh_node>(s.world, s.bvh_options);
+    s.world = hittable_list(s.bvh);
+    s.cam.materials = s.materials;
+    references = s.bvh->stats().primitives;
+
+    std::vector<std::vector<uint8_t>> frames;
+    s.cam.render_sequence(s.world, [&](const std::vector<uint8_t>& pixels) {
+        frames.push_back(pixels);
+        return true;
+    });
+    return frames;
+}
+
+int main() {
+    size_t references = 0, primitives = 0;
+    auto expected = render_frames(bvh_split::sah, 0, references, primitives);
+    bool ok = true;
+
+    for (auto split : { bvh_split::sah, bvh_split::median, bvh_split::lbvh, bvh_split::sbvh }) {
+        for (double threshold : { 0.0, 1.5 }) {
+            auto frames = render_frames(split, threshold, references, primitives);
+            size_t differing = 0;
+            for (size_t f = 0; f < expected.size(); f++)
+                differing += f >= frames.size() || frames[f] != expected[f];
+
+            std::clog << bvh_split_name(split) << (threshold > 0 ? ", refit: " : ", rebuilt: ")
+                << references << " references to " << primitives << " primitives, " << differing << " of " << expected.size()
+                << " frames differ\n";
+            ok = ok && differing == 0;
+        }
+    }
+
+    std::clog << (ok ? "PASS" : "FAIL") << '\n';
+    return ok ? 0 : 1;
+}
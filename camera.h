@@ -4,14 +4,28 @@
 #include "rt.h"
 
 #include "hittable.h"
+#include "hittable_list.h"
 #include "material.h"
+#include "sampler.h"
+#include "thread_pool.h"
+
+#include <cassert>
+#include <chrono>
+#include <functional>
+
+// Receives every finished frame or progressive pass as 8-bit RGB scanlines (image_width * 3
+// bytes per row). Returning false stops the render after that frame or pass.
+using frame_callback = std::function<bool(const std::vector<uint8_t>& pixels)>;
 
 class camera {
 public:
     double aspect_ratio = 1.0;  // Ratio of image width over height
     int    image_width = 100;  // Rendered image width in pixel count
     int    samples_per_pixel = 10;   // Count of random samples for each pixel
+    int    samples_per_pass = 1;     // Samples added to every pixel per progressive pass
+    sampler_type sampling = sampler_type::independent;  // Pattern feeding pixel, lens, time and bounce samples
     int    max_depth = 10;   // Maximum number of ray bounces into scene
+    int    roulette_depth = 3;  // Bounces after which Russian roulette may end a path
 
     double vfov = 90;  // Vertical view angle (field of view)
     point3 lookfrom = point3(0, 0, 0);   // Point camera is looking from
@@ -21,35 +35,107 @@ public:
     double defocus_angle = 0;  // Variation angle of rays through each pixel
     double focus_dist = 10;    // Distance from camera lookfrom point to plane of perfect focus
 
-        int total_frames = 1;
+    bool   adaptive_sampling = false;   // Stop converged pixels early and spend the budget on noisy ones
+    double adaptive_threshold = 0.02;   // Relative standard error at which a pixel counts as converged
+    int    adaptive_min_samples = 8;    // Samples every pixel takes before convergence is tested (at most half the budget)
+    int    adaptive_max_samples = 0;    // Per-pixel sample cap (0 = 8x samples_per_pixel)
+
+    int total_frames = 1;
     double frame_duration = 1.0 / 24.0; // Default to 24 fps
     double shutter_duration = 1.0 / 48.0; // Default to half the frame duration
 
+    uint64_t seed = thread_random::scene_seed();  // Scene seed keying every pixel sample's random stream
+
+    int    thread_count = 0;  // Worker threads used for rendering (0 = hardware concurrency)
+    int    tile_size = 16;    // Edge length in pixels of the square tiles handed to workers
+    bool   scaling_report = false; // Log a 1, 2, 4, ... thread sweep before rendering
+
+    // The materials named by the world's material IDs. build_scene sets it; a camera set up
+    // without build_scene must be given the table its world was built against before rendering.
+    shared_ptr<const material_table> materials;
+
+    struct render_stats {
+        int    threads = 0;      // Worker threads that took part in the render
+        size_t tiles = 0;        // Tiles the image was split into
+        size_t stolen_tiles = 0; // Tiles a worker took from another worker's queue
+        double seconds = 0;      // Wall-clock time of the last frame
+        uint64_t rays = 0;       // Rays traced in the last frame, primary and secondary
+
+        double rays_per_second() const { return seconds > 0 ? rays / seconds : 0.0; }
+    };
+
+    const render_stats& last_render_stats() const { return stats; }
+
     void render(const hittable& world, uint8_t* pixels) {
         initialize();
+        if (scaling_report)
+            report_thread_scaling(world, pixels);
+        reset_accumulation();
+        if (adaptive_sampling)
+            render_adaptive(world, pixels);
+        else
+            render_frame(world, pixels, interval(0, 1), 0, samples_per_pixel);
+        report_render_stats();
+    }
 
-        for (int j = 0; j < image_height; j++) {
-            for (int i = 0; i < image_width; i++) {
-                color pixel_color(0, 0, 0);
-                for (int sample = 0; sample < samples_per_pixel; sample++) {
-                    ray r = get_ray(i, j);
-                    pixel_color += ray_color(r, max_depth, world);
-                }
-                int index = (j * image_width + i) * 3;
+    void render_pass(const hittable& world, uint8_t* pixels) {
+        // Adds samples_per_pass samples to every pixel of the accumulation buffer and writes the
+        // running average to pixels. Successive calls keep refining the same image until
+        // reset_accumulation() is called or the image size changes.
+        initialize();
+        render_frame(world, pixels, interval(0, 1), 0, samples_per_pass);
+    }
 
-                // Gamma correction
-                pixel_color = color(linear_to_gamma(pixel_samples_scale * pixel_color.x()), linear_to_gamma(pixel_samples_scale * pixel_color.y()), linear_to_gamma(pixel_samples_scale * pixel_color.z()));
+    void render_progressive(const hittable& world, const frame_callback& on_pass) {
+        // Runs passes until samples_per_pixel samples have been accumulated, handing the
+        // running average to on_pass after every pass. If on_pass returns false the render
+        // stops between passes and keeps the accumulated samples, so a later call resumes
+        // where this one left off.
+        initialize();
 
-                pixels[index] = std::clamp((int)(255.999 * pixel_color.x()), 0, 255);
-                pixels[index + 1] = std::clamp((int)(255.999 * pixel_color.y()), 0, 255);
-                pixels[index + 2] = std::clamp((int)(255.999 * pixel_color.z()), 0, 255);
-            }
+        std::vector<uint8_t> pixels(image_width * image_height * 3);
+
+        while (accumulated_samples < samples_per_pixel) {
+            auto pass_samples = std::min(samples_per_pass, samples_per_pixel - accumulated_samples);
+            render_frame(world, pixels.data(), interval(0, 1), 0, std::max(pass_samples, 1));
+
+            if (!on_pass(pixels))
+                return;
         }
 
+        report_render_stats();
     }
 
+    void reset_accumulation() {
+        std::fill(accumulation.begin(), accumulation.end(), 0.0f);
+        std::fill(luminance_squares.begin(), luminance_squares.end(), 0.0f);
+        std::fill(sample_counts.begin(), sample_counts.end(), 0);
+        std::fill(converged.begin(), converged.end(), uint8_t(0));
+        accumulated_samples = 0;
+    }
+
+    // Samples per pixel gathered in the accumulation buffer so far.
+    int accumulated_spp() const { return accumulated_samples; }
+
+    // Linear RGB sums of all accumulated samples, three floats per pixel in scanline order.
+    const std::vector<float>& accumulation_buffer() const { return accumulation; }
+
+    // Number of samples each pixel has taken, in scanline order.
+    const std::vector<int>& pixel_sample_counts() const { return sample_counts; }
+
+    void write_sample_count_map(uint8_t* pixels) const {
+        // Writes the per-pixel sample counts as a grayscale RGB image scaled so that the most
+        // sampled pixel is white, to show where an adaptive render spent its time.
+        auto max_count = std::max(1, *std::max_element(sample_counts.begin(), sample_counts.end()));
+        for (size_t p = 0; p < sample_counts.size(); p++) {
+            auto level = uint8_t(255.0 * sample_counts[p] / max_count);
+            pixels[3 * p] = pixels[3 * p + 1] = pixels[3 * p + 2] = level;
+        }
+    }
 
-    void render_sequence(const hittable& world, SDL_Renderer* renderer, SDL_Texture* texture) {
+    void render_sequence(const hittable& world, const frame_callback& on_frame) {
+        // Renders total_frames frames, updating the world to each frame's start time first,
+        // and hands every frame to on_frame. Returning false from on_frame ends the sequence.
         initialize();
 
         std::vector<uint8_t> pixels(image_width * image_height * 3);
@@ -61,47 +147,33 @@ public:
             // Update all objects in the world for this frame
             update_world(world, frame_start_time);
 
-            for (int j = 0; j < image_height; ++j) {
-                for (int i = 0; i < image_width; ++i) {
-                    color pixel_color(0, 0, 0);
-                    for (int sample = 0; sample < samples_per_pixel; ++sample) {
-                        auto time = RandomGenerator::instance().random_double(frame_start_time, frame_end_time);
-                        ray r = get_ray(i, j, time);
-                        pixel_color += ray_color(r, max_depth, world);
-                    }
-
-                    int index = (j * image_width + i) * 3;
+            reset_accumulation();
+            render_frame(world, pixels.data(), interval(frame_start_time, frame_end_time), frame,
+                samples_per_pixel);
 
-                    // Gamma correction
-                    pixel_color = color(linear_to_gamma(pixel_samples_scale * pixel_color.x()), linear_to_gamma(pixel_samples_scale * pixel_color.y()), linear_to_gamma(pixel_samples_scale * pixel_color.z()));
-
-                    pixels[index] = std::clamp((int)(255.999 * pixel_color.x()), 0, 255);
-                    pixels[index + 1] = std::clamp((int)(255.999 * pixel_color.y()), 0, 255);
-                    pixels[index + 2] = std::clamp((int)(255.999 * pixel_color.z()), 0, 255);
-                }
-            }
-
-            // Update SDL texture and render
-            SDL_UpdateTexture(texture, nullptr, pixels.data(), image_width * 3);
-            SDL_RenderClear(renderer);
-            SDL_RenderCopy(renderer, texture, nullptr, nullptr);
-            SDL_RenderPresent(renderer);
+            if (!on_frame(pixels))
+                return;
+        }
+    }
 
-            SDL_Event event;
-            while (SDL_PollEvent(&event)) {
-                if (event.type == SDL_QUIT) {
-                    return;
-                }
-            }
+    int image_height_pixels() const {
+        // Height the image will have for the current image_width and aspect_ratio.
+        return std::max(1, int(image_width / aspect_ratio));
+    }
 
-            // Add a small delay to control frame rate
-            SDL_Delay(static_cast<Uint32>(1000 * frame_duration));
+    std::vector<float> linear_image() const {
+        // The accumulated samples averaged per pixel: linear RGB floats in scanline order.
+        std::vector<float> image(accumulation.size());
+        for (size_t p = 0; p < sample_counts.size(); p++) {
+            auto scale = sample_counts[p] > 0 ? 1.0f / sample_counts[p] : 0.0f;
+            for (int c = 0; c < 3; c++)
+                image[3 * p + c] = accumulation[3 * p + c] * scale;
         }
+        return image;
     }
 
 private:
     int    image_height;    // Rendered image height
-    double pixel_samples_scale;  // Color scale factor for a sum of pixel samples
     point3 center;         // Camera center
     point3 pixel00_loc;    // Location of pixel 0, 0
     vec3   pixel_delta_u;  // Offset to pixel to the right
@@ -110,11 +182,23 @@ private:
     vec3   defocus_disk_u;       // Defocus disk horizontal radius
     vec3   defocus_disk_v;       // Defocus disk vertical radius
 
+    std::unique_ptr<thread_pool> pool;  // Tile workers, kept alive across frames
+    std::vector<std::unique_ptr<sampler>> patterns;  // One sample pattern per tile worker
+    sampler_type patterns_type = sampler_type::independent;  // What patterns were made for
+    int patterns_samples = 0;
+    render_stats stats;
+    std::atomic<uint64_t> traced_rays{ 0 };  // Rays traced by all workers in the current frame
+
+    std::vector<float> accumulation;  // Linear RGB sample sums, persistent between passes
+    std::vector<float> luminance_squares;  // Per-pixel sums of squared sample luminance
+    std::vector<int> sample_counts;   // Samples taken by each pixel
+    std::vector<uint8_t> converged;   // Pixels the adaptive sampler has stopped
+    int accumulated_samples = 0;      // Samples per pixel added by uniform passes
+
     void initialize() {
-        image_height = int(image_width / aspect_ratio);
-        image_height = (image_height < 1) ? 1 : image_height;
+        assert(materials && "camera::materials must be set to the world's material table");
 
-        pixel_samples_scale = 1.0 / samples_per_pixel;
+        image_height = image_height_pixels();
 
         center = lookfrom;
 
@@ -145,42 +229,299 @@ private:
         auto defocus_radius = focus_dist * std::tan(degrees_to_radians(defocus_angle / 2));
         defocus_disk_u = u * defocus_radius;
         defocus_disk_v = v * defocus_radius;
+
+        if (!pool || pool->thread_count() != resolved_thread_count())
+            pool = std::make_unique<thread_pool>(resolved_thread_count());
+
+        auto accumulation_size = size_t(image_width) * image_height * 3;
+        if (accumulation.size() != accumulation_size) {
+            auto pixel_count = accumulation_size / 3;
+            accumulation.assign(accumulation_size, 0.0f);
+            luminance_squares.assign(pixel_count, 0.0f);
+            sample_counts.assign(pixel_count, 0);
+            converged.assign(pixel_count, 0);
+            accumulated_samples = 0;
+        }
+    }
+
+    int resolved_thread_count() const {
+        return thread_count > 0 ? thread_count : thread_pool::default_thread_count();
+    }
+
+    void render_frame(const hittable& world, uint8_t* pixels, interval shutter, int frame,
+        int sample_count, bool adaptive = false) {
+        // Split the image into tiles and let the pool's workers drain them. Every pixel is
+        // written by exactly one tile, so the workers never touch the same output bytes.
+        auto start = std::chrono::steady_clock::now();
+
+        int tile = std::max(tile_size, 1);
+        int tiles_x = (image_width + tile - 1) / tile;
+        int tiles_y = (image_height + tile - 1) / tile;
+        size_t tile_count = size_t(tiles_x) * tiles_y;
+
+        // Fold the frame into the seed so an animation does not repeat the same noise pattern.
+        uint64_t frame_seed = seed + golden_gamma * uint64_t(frame);
+        traced_rays = 0;
+        prepare_patterns();
+
+        pool->parallel_for(tile_count, [&](size_t index, int worker) {
+            int x0 = int(index % tiles_x) * tile;
+            int y0 = int(index / tiles_x) * tile;
+            render_tile(world, pixels, x0, y0, std::min(x0 + tile, image_width),
+                std::min(y0 + tile, image_height), shutter, frame_seed, sample_count, adaptive,
+                patterns.empty() ? nullptr : patterns[worker].get());
+        });
+        if (!adaptive)
+            accumulated_samples += sample_count;
+
+        stats.threads = pool->thread_count();
+        stats.tiles = tile_count;
+        stats.stolen_tiles = pool->steal_count();
+        stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        stats.rays = traced_rays;
+    }
+
+    void prepare_patterns() {
+        // Makes one sampler per worker of the pool for the current pattern and sample count.
+        // Workers keep theirs for every tile and pass; start_pixel_sample resets it for each
+        // pixel sample, so no sampler is allocated per tile.
+        if (sampling == sampler_type::independent) {
+            patterns.clear();
+            return;
+        }
+        if (patterns_type == sampling && patterns_samples == samples_per_pixel
+            && patterns.size() >= size_t(pool->thread_count()))
+            return;
+
+        patterns.clear();
+        for (int w = 0; w < pool->thread_count(); w++)
+            patterns.push_back(make_sampler(sampling, samples_per_pixel));
+        patterns_type = sampling;
+        patterns_samples = samples_per_pixel;
+    }
+
+    void render_tile(const hittable& world, uint8_t* pixels, int x0, int y0, int x1, int y1,
+        interval shutter, uint64_t frame_seed, int sample_count, bool adaptive, sampler* pattern) {
+        // Every sample draws from a stream keyed by (seed, pixel, sample), so the tile layout
+        // and the thread that happens to render it cannot change the image. Sample indices
+        // continue from the pixel's own count, so passes never repeat a sample. pattern is the
+        // calling worker's sampler, or null for independent samples.
+        auto& rng = thread_random::local();
+        auto max_samples = adaptive_sample_cap();
+        uint64_t tile_rays = 0;
+
+        for (int j = y0; j < y1; j++) {
+            for (int i = x0; i < x1; i++) {
+                auto pixel = size_t(j) * image_width + i;
+                if (adaptive && converged[pixel])
+                    continue;
+
+                auto first_sample = sample_counts[pixel];
+                auto last_sample = first_sample + sample_count;
+                if (adaptive)
+                    last_sample = std::min(last_sample, max_samples);
+
+                color pixel_color(0, 0, 0);
+                double luminance_square_sum = 0;
+                for (int sample = first_sample; sample < last_sample; sample++) {
+                    rng.begin_sample(frame_seed, pixel, sample);
+                    if (pattern) {
+                        pattern->start_pixel_sample(frame_seed, i, j, pixel, sample);
+                        rng.use_pattern(pattern);
+                    }
+                    auto time = random_double(shutter.min, shutter.max);
+                    ray r = get_ray(i, j, time);
+                    auto sample_color = ray_color(r, world, tile_rays);
+                    auto y = luminance(sample_color);
+                    pixel_color += sample_color;
+                    luminance_square_sum += y * y;
+                }
+
+                float* sum = &accumulation[3 * pixel];
+                sum[0] += float(pixel_color.x());
+                sum[1] += float(pixel_color.y());
+                sum[2] += float(pixel_color.z());
+                luminance_squares[pixel] += float(luminance_square_sum);
+                sample_counts[pixel] = last_sample;
+
+                if (adaptive)
+                    converged[pixel] = last_sample >= max_samples || has_converged(pixel);
+
+                write_pixel(pixels + 3 * pixel, color(sum[0], sum[1], sum[2]) / last_sample);
+            }
+        }
+
+        rng.end_sample();
+        traced_rays += tile_rays;
+    }
+
+    void render_adaptive(const hittable& world, uint8_t* pixels) {
+        // Every pixel first takes adaptive_first_pass() samples, at most half the budget. After
+        // that, passes only visit pixels whose relative standard error is still above
+        // adaptive_threshold, until the budget of samples_per_pixel samples per pixel on average
+        // is spent, every pixel has converged, or the noisy pixels hit the per-pixel cap. No
+        // pass is started that could take the total past the budget.
+        auto pixel_count = sample_counts.size();
+        auto budget = size_t(std::max(samples_per_pixel, 1)) * pixel_count;
+        auto first_pass = adaptive_first_pass();
+        auto batch = size_t(std::max(1, first_pass / 2));
+        double seconds = 0;
+        uint64_t rays = 0;
+
+        render_frame(world, pixels, interval(0, 1), 0, first_pass, true);
+        seconds += stats.seconds;
+        rays += stats.rays;
+
+        while (true) {
+            size_t spent = 0, active = 0;
+            for (size_t p = 0; p < pixel_count; p++) {
+                spent += sample_counts[p];
+                active += converged[p] ? 0 : 1;
+            }
+            if (active == 0 || spent >= budget)
+                break;
+
+            // The last pass shrinks to what is left of the budget.
+            auto pass_samples = std::min(batch, (budget - spent) / active);
+            if (pass_samples == 0)
+                break;
+
+            render_frame(world, pixels, interval(0, 1), 0, int(pass_samples), true);
+            seconds += stats.seconds;
+            rays += stats.rays;
+        }
+        stats.seconds = seconds;
+        stats.rays = rays;
+
+        size_t total = 0, done = 0;
+        for (size_t p = 0; p < pixel_count; p++) {
+            total += sample_counts[p];
+            done += converged[p];
+        }
+        std::clog << "Adaptive sampling: " << double(total) / pixel_count << " spp on average, "
+            << 100.0 * done / pixel_count << "% of pixels converged\n";
     }
 
-    color ray_color(const ray& r, int depth, const hittable& world) const {
-        if (depth <= 0)
-            return color(0, 0, 0);
+    int adaptive_sample_cap() const {
+        return adaptive_max_samples > 0 ? adaptive_max_samples : 8 * samples_per_pixel;
+    }
+
+    int adaptive_first_pass() const {
+        // Samples every pixel takes before convergence is tested: adaptive_min_samples, but no
+        // more than half the budget (and at least the two a variance needs), so that some of the
+        // budget is left to move to the noisy pixels.
+        return std::max(1, std::min({ adaptive_min_samples, std::max(2, samples_per_pixel / 2),
+            samples_per_pixel, adaptive_sample_cap() }));
+    }
+
+    bool has_converged(size_t pixel) const {
+        // Compares the standard error of the pixel's mean luminance against the mean itself.
+        // A small absolute floor keeps black pixels from never converging.
+        auto n = sample_counts[pixel];
+        if (n < std::max(adaptive_first_pass(), 2))
+            return false;
+
+        const float* sum = &accumulation[3 * pixel];
+        auto mean = luminance(color(sum[0], sum[1], sum[2])) / n;
+        auto variance = std::max(0.0, (luminance_squares[pixel] - n * mean * mean) / (n - 1));
+        auto standard_error = std::sqrt(variance / n);
+
+        return standard_error <= adaptive_threshold * std::max(mean, 1e-3);
+    }
+
+    static double luminance(const color& c) {
+        return 0.2126 * c.x() + 0.7152 * c.y() + 0.0722 * c.z();
+    }
 
-        hit_record rec;
+    static void write_pixel(uint8_t* pixel, const color& linear_color) {
+        // Gamma correction
+        auto r = linear_to_gamma(linear_color.x());
+        auto g = linear_to_gamma(linear_color.y());
+        auto b = linear_to_gamma(linear_color.z());
+
+        pixel[0] = std::clamp((int)(255.999 * r), 0, 255);
+        pixel[1] = std::clamp((int)(255.999 * g), 0, 255);
+        pixel[2] = std::clamp((int)(255.999 * b), 0, 255);
+    }
+
+    void report_thread_scaling(const hittable& world, uint8_t* pixels) {
+        // Render the frame with 1, 2, 4, ... workers up to the configured count and log the
+        // speedup and parallel efficiency of each run against the single-threaded one.
+        int max_threads = resolved_thread_count();
+        double single_thread_seconds = 0;
+
+        std::clog << "threads  time(ms)  speedup  efficiency\n";
+        for (int threads = 1; ; threads = std::min(threads * 2, max_threads)) {
+            pool = std::make_unique<thread_pool>(threads);
+            reset_accumulation();
+            render_frame(world, pixels, interval(0, 1), 0, samples_per_pixel);
+            if (threads == 1)
+                single_thread_seconds = stats.seconds;
+
+            auto speedup = single_thread_seconds / stats.seconds;
+            std::clog << threads << "  " << stats.seconds * 1000.0 << "  " << speedup << "  "
+                << speedup / threads << '\n';
+
+            if (threads == max_threads)
+                break;
+        }
+    }
+
+    void report_render_stats() const {
+        std::clog << "Rendered " << image_width << 'x' << image_height << " in "
+            << stats.seconds * 1000.0 << " ms on " << stats.threads << " threads ("
+            << stats.tiles << " tiles, " << stats.stolen_tiles << " stolen), "
+            << stats.rays_per_second() * 1e-6 << " Mrays/s\n";
+    }
+
+    color ray_color(const ray& r, const hittable& world, uint64_t& rays) const {
+        // Follows the path in a loop, carrying the product of the attenuations seen so far as
+        // the path throughput. After roulette_depth bounces a path survives each further
+        // bounce with a probability tied to its throughput and is reweighted by 1/p when it
+        // does, which ends low-contribution paths early without biasing the estimate.
+        auto& rng = thread_random::local();
+        ray path_ray = r;
+        color throughput(1, 1, 1);
+
+        for (int bounce = 1; bounce <= max_depth; bounce++) {
+            // Bounce 0 holds the camera dimensions (time, pixel offset, lens), so path
+            // vertices start at 1.
+            rng.start_bounce(uint32_t(bounce));
+
+            hit_record rec;
+            rays++;
+            if (!world.hit(path_ray, interval(0.001, infinity), rec))
+                return throughput * background(path_ray);
 
-        if (world.hit(r, interval(0.001, infinity), rec)) {
             ray scattered;
             color attenuation;
-            if (rec.mat->scatter(r, rec, attenuation, scattered))
-                return attenuation * ray_color(scattered, depth - 1, world);
-            return color(0, 0, 0);
+            if (!(*materials)[rec.mat].scatter(path_ray, rec, attenuation, scattered))
+                return color(0, 0, 0);
+
+            throughput = throughput * attenuation;
+
+            if (bounce >= roulette_depth) {
+                // Capped below one so lossless dielectric chains terminate as well.
+                auto survival = std::min(max_component(throughput), 0.95);
+                if (random_double() >= survival)
+                    return color(0, 0, 0);
+                throughput /= survival;
+            }
+
+            path_ray = scattered;
         }
 
+        return color(0, 0, 0);
+    }
+
+    static color background(const ray& r) {
         vec3 unit_direction = unit_vector(r.direction());
         auto a = 0.5 * (unit_direction.y() + 1.0);
         return (1.0 - a) * color(1.0, 1.0, 1.0) + a * color(0.5, 0.7, 1.0);
     }
 
-
-    ray get_ray(int i, int j) const {
-        // Construct a camera ray originating from the origin and directed at randomly sampled
-        // point around the pixel location i, j.
-
-        auto offset = sample_square();
-        auto pixel_sample = pixel00_loc
-            + ((i + offset.x()) * pixel_delta_u)
-            + ((j + offset.y()) * pixel_delta_v);
-
-        auto ray_origin = (defocus_angle <= 0) ? center : defocus_disk_sample();
-        auto ray_direction = pixel_sample - ray_origin;
-        auto ray_time = RandomGenerator::instance().random_double();
-
-        return ray(ray_origin, ray_direction, ray_time);
+    static double max_component(const color& c) {
+        return std::max({ c.x(), c.y(), c.z() });
     }
 
     ray get_ray(int i, int j, double ray_time) const {
@@ -206,7 +547,9 @@ private:
 
     vec3 sample_square() const {
         // Returns the vector to a random point in the [-.5,-.5]-[+.5,+.5] unit square.
-        return vec3(RandomGenerator::instance().random_double() - 0.5, RandomGenerator::instance().random_double() - 0.5, 0);
+        double u, v;
+        random_double2(u, v);
+        return vec3(u - 0.5, v - 0.5, 0);
     }
     
     point3 defocus_disk_sample() const {
@@ -215,7 +558,7 @@ private:
         return center + (p[0] * defocus_disk_u) + (p[1] * defocus_disk_v);
     }
 
-    inline double linear_to_gamma(double linear_component)
+    static double linear_to_gamma(double linear_component)
     {
         if (linear_component > 0)
             return std::sqrt(linear_component);
@@ -0,0 +1,233 @@
+#include "rt.h"
+
+#include "camera.h"
+#include "image_writer.h"
+#include "scenes.h"
+
+#include <cstdlib>
+#include <iomanip>
+#include <sstream>
+#include <string>
+
+// Command-line renderer for machines without a display. It never touches SDL: the scene is
+// rendered through camera::render / camera::render_sequence and written to PNG, PPM or PFM
+// files chosen by the output file's extension.
+//
+// Example:
+//   rt_headless --scene bouncing_spheres --width 1280 --spp 64 --threads 32 --output out.png
+
+void print_usage() {
+    std::clog <<
+        "Usage: rt_headless [options]\n"
+        "  --scene NAME         Scene to render, or a .obj mesh file (default perlin_spheres)\n"
+        "  --list               List the built-in scenes\n"
+        "  --instances N        Place N instances of an .obj mesh, sharing one mesh BVH\n"
+        "  --width N            Image width in pixels (default 400)\n"
+        "  --spp N              Samples per pixel (default: the scene's)\n"
+        "  --depth N            Maximum bounces (default: the scene's)\n"
+        "  --threads N          Worker threads (default: hardware concurrency)\n"
+        "  --seed N             Scene seed\n"
+        "  --sampler NAME       independent, stratified, halton, sobol or blue_noise\n"
+        "  --bvh SPLIT          BVH builder: sah, median, lbvh, sbvh or auto (default: lbvh for\n"
+        "                       animated scenes, which update it every frame, sah otherwise)\n"
+        "  --split-budget X     sbvh: extra references spatial splits may add, as a fraction of\n"
+        "                       the primitive count (default 1)\n"
+        "  --bins N             SAH bins per axis (default 16)\n"
+        "  --leaf-size N        Most primitives per BVH leaf (default 4)\n"
+        "  --bvh-width N        Children per BVH node: 2 (default), 4 or 8\n"
+        "  --rebuild-threshold X\n"
+        "                       Animated scenes refit their BVH every frame and rebuild it once\n"
+        "                       its SAH cost passes X times the built cost (default 1.5, 0 =\n"
+        "                       rebuild every frame)\n"
+        "  --adaptive           Adaptive sampling; --spp is the average budget\n"
+        "  --sample-map FILE    Also write the per-pixel sample counts as an image\n"
+        "  --frames N           Frames to render for animated scenes (default: the scene's)\n"
+        "  --scaling            Log a thread-count sweep before rendering\n"
+        "  --output FILE        Output image, .png, .ppm or .pfm (default out.png). Animated\n"
+        "                       scenes append the frame number before the extension.\n";
+}
+
+std::string frame_filename(const std::string& filename, int frame) {
+    auto dot = filename.find_last_of('.');
+    std::ostringstream name;
+    name << filename.substr(0, dot) << '_' << std::setw(4) << std::setfill('0') << frame;
+    if (dot != std::string::npos)
+        name << filename.substr(dot);
+    return name.str();
+}
+
+int main(int argc, char* argv[]) {
+
+    std::string scene_name = "perlin_spheres";
+    std::string output = "out.png";
+    std::string sample_map;
+    int image_width = 400;
+    int samples_per_pixel = 0;
+    int max_depth = 0;
+    int thread_count = 0;
+    int frames = 0;
+    int mesh_instances = 1;
+    bool adaptive = false;
+    bool scaling_report = false;
+    sampler_type sampling = sampler_type::independent;
+    bvh_build_options bvh_options;
+
+    for (int arg = 1; arg < argc; arg++) {
+        std::string option = argv[arg];
+        bool has_value = arg + 1 < argc;
+
+        if (option == "--help" || option == "-h") {
+            print_usage();
+            return 0;
+        }
+        else if (option == "--list") {
+            for (const auto& entry : scene_list())
+                std::cout << entry.name << '\n';
+            return 0;
+        }
+        else if (option == "--adaptive")
+            adaptive = true;
+        else if (option == "--scaling")
+            scaling_report = true;
+        else if (!has_value) {
+            std::cerr << "Missing value for option: " << option << std::endl;
+            print_usage();
+            return 1;
+        }
+        else if (option == "--scene")
+            scene_name = argv[++arg];
+        else if (option == "--output")
+            output = argv[++arg];
+        else if (option == "--sample-map")
+            sample_map = argv[++arg];
+        else if (option == "--width")
+            image_width = std::atoi(argv[++arg]);
+        else if (option == "--spp")
+            samples_per_pixel = std::atoi(argv[++arg]);
+        else if (option == "--depth")
+            max_depth = std::atoi(argv[++arg]);
+        else if (option == "--threads")
+            thread_count = std::atoi(argv[++arg]);
+        else if (option == "--frames")
+            frames = std::atoi(argv[++arg]);
+        else if (option == "--instances")
+            mesh_instances = std::atoi(argv[++arg]);
+        else if (option == "--seed")
+            seed_random(std::stoull(argv[++arg]));
+        else if (option == "--bvh") {
+            if (!parse_bvh_split(argv[++arg], bvh_options.split)) {
+                std::cerr << "Unknown BVH split: " << argv[arg] << std::endl;
+                return 1;
+            }
+        }
+        else if (option == "--bins")
+            bvh_options.bin_count = std::atoi(argv[++arg]);
+        else if (option == "--leaf-size")
+            bvh_options.max_leaf_size = std::atoi(argv[++arg]);
+        else if (option == "--bvh-width")
+            bvh_options.width = std::atoi(argv[++arg]);
+        else if (option == "--rebuild-threshold")
+            bvh_options.rebuild_threshold = std::atof(argv[++arg]);
+        else if (option == "--split-budget")
+            bvh_options.split_budget = std::atof(argv[++arg]);
+        else if (option == "--sampler") {
+            if (!parse_sampler_type(argv[++arg], sampling)) {
+                std::cerr << "Unknown sampler: " << argv[arg] << std::endl;
+                return 1;
+            }
+        }
+        else {
+            std::cerr << "Unknown option: " << option << std::endl;
+            print_usage();
+            return 1;
+        }
+    }
+
+    if (image_width < 1) {
+        std::cerr << "Image width must be positive" << std::endl;
+        return 1;
+    }
+    if (bvh_options.width != 2 && bvh_options.width != 4 && bvh_options.width != 8) {
+        std::cerr << "BVH width must be 2, 4 or 8" << std::endl;
+        return 1;
+    }
+
+    scene s;
+    s.bvh_options = bvh_options;
+    s.mesh_instances = mesh_instances;
+    if (!build_scene(scene_name, s)) {
+        std::cerr << "Unknown scene: " << scene_name << " (see --list)" << std::endl;
+        return 1;
+    }
+
+    std::clog << s.materials->size() << " materials (" << s.materials->added() << " before merging duplicates)\n";
+    if (s.bvh) {
+        auto stats = s.bvh->stats(bvh_options.traversal_cost);
+        std::clog << bvh_split_name(s.bvh_options.split) << " BVH over " << s.primitives << " primitives built in " << s.bvh_seconds * 1000.0
+            << " ms: " << stats.interior_nodes << " interior nodes, " << stats.leaves
+            << " leaves (" << stats.primitives << " references), depth " << stats.max_depth << ", SAH cost " << stats.sah_cost << ", "
+            << s.bvh->width() << "-wide ("
+            << s.bvh_seconds * 1e6 / s.primitives << " s per million primitives)\n";
+        const auto& leaves = s.bvh->leaf_primitives();
+        std::clog << "Leaf primitives: " << leaves.sphere_count() << " spheres and " << leaves.triangle_count()
+            << " triangles stored by type, " << leaves.other_count() << " others called virtually\n";
+    }
+    if (s.mesh) {
+        auto stats = s.mesh->stats(bvh_options.traversal_cost);
+        std::clog << "Mesh of " << s.mesh->triangle_count() << " triangles over " << s.mesh->vertex_count()
+            << " vertices, " << s.mesh->memory_bytes() / 1024.0 << " KiB ("
+            << double(s.mesh->memory_bytes()) / s.mesh->triangle_count() << " bytes per triangle), "
+            << bvh_split_name(s.mesh->build_options().split) << " BVH built in " << s.mesh->build_seconds() * 1000.0
+            << " ms: " << stats.leaves << " leaves (" << stats.primitives << " references), depth "
+            << stats.max_depth << ", SAH cost " << stats.sah_cost << ", " << s.mesh->width() << "-wide\n";
+    }
+
+    camera& cam = s.cam;
+    cam.image_width = image_width;
+    cam.thread_count = thread_count;
+    cam.adaptive_sampling = adaptive;
+    cam.scaling_report = scaling_report;
+    cam.sampling = sampling;
+    if (samples_per_pixel > 0)
+        cam.samples_per_pixel = samples_per_pixel;
+    if (max_depth > 0)
+        cam.max_depth = max_depth;
+    if (frames > 0)
+        cam.total_frames = frames;
+
+    int image_height = cam.image_height_pixels();
+    bool ok = true;
+
+    if (s.animated) {
+        int frame = 0;
+        cam.render_sequence(s.world, [&](const std::vector<uint8_t>& pixels) {
+            auto filename = frame_filename(output, frame++);
+            if (s.bvh) {
+                std::clog << "BVH " << (s.bvh->rebuilt_on_update() ? "rebuilt" : "refit") << " in "
+                    << s.bvh->update_seconds() * 1000.0 << " ms, SAH cost " << s.bvh->sah_cost()
+                    << " (" << s.bvh->built_sah_cost() << " after the last build)\n";
+            }
+            ok = write_image(filename, image_width, image_height, pixels, cam.linear_image()) && ok;
+            std::clog << "Wrote " << filename << '\n';
+            return true;
+        });
+    }
+    else {
+        std::vector<uint8_t> pixels(image_width * image_height * 3);
+        cam.render(s.world, pixels.data());
+        ok = write_image(output, image_width, image_height, pixels, cam.linear_image());
+        std::clog << "Wrote " << output << '\n';
+    }
+
+    if (!sample_map.empty()) {
+        std::vector<uint8_t> map(image_width * image_height * 3);
+        cam.write_sample_count_map(map.data());
+
+        std::vector<float> linear_map(map.begin(), map.end());
+        for (auto& value : linear_map)
+            value /= 255.0f;
+        ok = write_image(sample_map, image_width, image_height, map, linear_map) && ok;
+    }
+
+    return ok ? 0 : 1;
+}
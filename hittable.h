@@ -4,17 +4,21 @@
 #include "rt.h"
 #include "aabb.h"
 
-class material;
+class hittable;
+
+using material_id = uint32_t;  // Position of a material in the scene's material_table
 
 class hit_record {
 public:
     point3 p;
     vec3 normal;
-    shared_ptr<material> mat;
+    material_id mat = 0;
     double t;
     double u; // texture coordinates u
     double v; // texture coordinates v
     bool front_face;
+    const hittable* object = nullptr;  // Set by intersect() while the surface data is still to come
+    uint32_t primitive = 0;            // Which part of object was hit, for objects made of many
 
     void set_face_normal(const ray& r, const vec3& outward_normal) {
         front_face = dot(r.direction(), outward_normal) < 0;
@@ -28,9 +32,61 @@ public:
 
     virtual bool hit(const ray& r, interval ray_t, hit_record& rec) const = 0;
 
+    // Closest-hit queries run in two phases. intersect() finds the hit and sets only rec.t, plus
+    // rec.object (and rec.primitive) if the rest of the record is left for that object's
+    // finalize(); the point, normal, texture coordinates and material are then computed once,
+    // for the closest hit, rather than for every closer hit found along the way. Both phases
+    // must see the same ray. rec is only written when a hit is found, so aggregates can pass
+    // the caller's record straight down. The default runs the whole of hit() in phase one.
+    virtual bool intersect(const ray& r, interval ray_t, hit_record& rec) const {
+        if (!hit(r, ray_t, rec))
+            return false;
+        rec.object = nullptr;
+        return true;
+    }
+
+    virtual void finalize(const ray& /*r*/, hit_record& /*rec*/) const {}
+
+    // Completes a record from intersect(), if its object left anything to do.
+    static void finish_hit(const ray& r, hit_record& rec) {
+        if (auto object = rec.object) {
+            rec.object = nullptr;
+            object->finalize(r, rec);
+        }
+    }
+
+protected:
+    // hit() for objects that implement intersect() and finalize().
+    bool two_phase_hit(const ray& r, interval ray_t, hit_record& rec) const {
+        if (!intersect(r, ray_t, rec))
+            return false;
+        finish_hit(r, rec);
+        return true;
+    }
+
+public:
+
+    // Any-hit query for visibility: true if anything intersects the ray within ray_t. Stops at
+    // the first intersection found and computes no surface data. Falls back to hit() for
+    // objects without a cheaper test.
+    virtual bool occluded(const ray& r, interval ray_t) const {
+        hit_record rec;
+        return hit(r, ray_t, rec);
+    }
+
     virtual void update(double time) = 0;
 
     virtual aabb bounding_box() const = 0;
+
+    // Splits the part of the object inside box at an axis-aligned plane, for BVH builders that
+    // divide a primitive between nodes: left and right bound what lies below and above
+    // position. The default cuts the box itself, which is conservative; triangles cut their
+    // actual surface.
+    virtual void split_box(const aabb& box, int axis, double position, aabb& left, aabb& right) const {
+        left = right = box;
+        left.intervals[axis].max = std::min(box.intervals[axis].max, position);
+        right.intervals[axis].min = std::max(box.intervals[axis].min, position);
+    }
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,178 @@
+#ifndef IMAGE_WRITER_H
+#define IMAGE_WRITER_H
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Writers for rendered images: 8-bit RGB as binary PPM or PNG, and linear float RGB as PFM.
+// Pixel data is in scanline order starting at the top-left pixel. Every writer returns false
+// and reports the file name on std::cerr if the file could not be written.
+
+inline bool write_ppm(const std::string& filename, int width, int height,
+    const std::vector<uint8_t>& pixels) {
+    std::ofstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open file: " << filename << std::endl;
+        return false;
+    }
+
+    file << "P6\n" << width << ' ' << height << "\n255\n";
+    file.write(reinterpret_cast<const char*>(pixels.data()), std::streamsize(width) * height * 3);
+    return bool(file);
+}
+
+inline bool write_pfm(const std::string& filename, int width, int height,
+    const std::vector<float>& pixels) {
+    // Portable float map: a negative scale marks little-endian data, and rows are stored from
+    // the bottom of the image up.
+    std::ofstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open file: " << filename << std::endl;
+        return false;
+    }
+
+    uint16_t probe = 1;
+    bool little_endian = *reinterpret_cast<uint8_t*>(&probe) == 1;
+
+    file << "PF\n" << width << ' ' << height << '\n' << (little_endian ? "-1.0" : "1.0") << '\n';
+    for (int j = height - 1; j >= 0; j--) {
+        file.write(reinterpret_cast<const char*>(&pixels[size_t(j) * width * 3]),
+            std::streamsize(width) * 3 * sizeof(float));
+    }
+    return bool(file);
+}
+
+class png_encoder {
+    // Minimal PNG encoder: 8-bit RGB, no filtering, and a zlib stream of stored (uncompressed)
+    // deflate blocks. The files are larger than a compressing encoder's but every viewer reads
+    // them and there is no dependency to ship.
+public:
+    static std::vector<uint8_t> encode(int width, int height, const std::vector<uint8_t>& pixels) {
+        // Each scanline is prefixed by its filter type (0: none).
+        std::vector<uint8_t> raw;
+        raw.reserve(size_t(height) * (width * 3 + 1));
+        for (int j = 0; j < height; j++) {
+            raw.push_back(0);
+            auto row = pixels.begin() + size_t(j) * width * 3;
+            raw.insert(raw.end(), row, row + size_t(width) * 3);
+        }
+
+        std::vector<uint8_t> zlib = { 0x78, 0x01 };
+        size_t offset = 0;
+        do {
+            auto block = std::min<size_t>(raw.size() - offset, 65535);
+            bool last = offset + block == raw.size();
+            zlib.push_back(last ? 1 : 0);
+            zlib.push_back(uint8_t(block));
+            zlib.push_back(uint8_t(block >> 8));
+            zlib.push_back(uint8_t(~block));
+            zlib.push_back(uint8_t(~block >> 8));
+            zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + block);
+            offset += block;
+        } while (offset < raw.size());
+        append_u32(zlib, adler32(raw));
+
+        std::vector<uint8_t> png = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+
+        std::vector<uint8_t> header;
+        append_u32(header, uint32_t(width));
+        append_u32(header, uint32_t(height));
+        header.insert(header.end(), { 8, 2, 0, 0, 0 });  // 8-bit depth, RGB, deflate, no filter, no interlace
+
+        append_chunk(png, "IHDR", header);
+        append_chunk(png, "IDAT", zlib);
+        append_chunk(png, "IEND", {});
+        return png;
+    }
+
+private:
+    static void append_u32(std::vector<uint8_t>& out, uint32_t value) {
+        out.push_back(uint8_t(value >> 24));
+        out.push_back(uint8_t(value >> 16));
+        out.push_back(uint8_t(value >> 8));
+        out.push_back(uint8_t(value));
+    }
+
+    static void append_chunk(std::vector<uint8_t>& out, const char* type,
+        const std::vector<uint8_t>& data) {
+        append_u32(out, uint32_t(data.size()));
+        auto crc_start = out.size();
+        out.insert(out.end(), type, type + 4);
+        out.insert(out.end(), data.begin(), data.end());
+        append_u32(out, crc32(&out[crc_start], out.size() - crc_start));
+    }
+
+    static uint32_t crc32(const uint8_t* data, size_t size) {
+        static const auto table = [] {
+            std::vector<uint32_t> t(256);
+            for (uint32_t n = 0; n < 256; n++) {
+                uint32_t c = n;
+                for (int k = 0; k < 8; k++)
+                    c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+                t[n] = c;
+            }
+            return t;
+        }();
+
+        uint32_t crc = 0xffffffffu;
+        for (size_t i = 0; i < size; i++)
+            crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+        return crc ^ 0xffffffffu;
+    }
+
+    static uint32_t adler32(const std::vector<uint8_t>& data) {
+        uint32_t a = 1, b = 0;
+        for (auto byte : data) {
+            a = (a + byte) % 65521;
+            b = (b + a) % 65521;
+        }
+        return (b << 16) | a;
+    }
+};
+
+inline bool write_png(const std::string& filename, int width, int height,
+    const std::vector<uint8_t>& pixels) {
+    std::ofstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open file: " << filename << std::endl;
+        return false;
+    }
+
+    auto png = png_encoder::encode(width, height, pixels);
+    file.write(reinterpret_cast<const char*>(png.data()), std::streamsize(png.size()));
+    return bool(file);
+}
+
+inline std::string file_extension(const std::string& filename) {
+    auto dot = filename.find_last_of('.');
+    if (dot == std::string::npos)
+        return "";
+
+    auto extension = filename.substr(dot + 1);
+    for (auto& c : extension)
+        c = char(std::tolower(static_cast<unsigned char>(c)));
+    return extension;
+}
+
+inline bool write_image(const std::string& filename, int width, int height,
+    const std::vector<uint8_t>& pixels, const std::vector<float>& linear_pixels) {
+    // Picks the format from the file extension: .png and .ppm take the 8-bit gamma-corrected
+    // pixels, .pfm takes the linear float ones.
+    auto extension = file_extension(filename);
+    if (extension == "png")
+        return write_png(filename, width, height, pixels);
+    if (extension == "ppm")
+        return write_ppm(filename, width, height, pixels);
+    if (extension == "pfm")
+        return write_pfm(filename, width, height, linear_pixels);
+
+    std::cerr << "Unknown image format for file: " << filename << " (use .png, .ppm or .pfm)" << std::endl;
+    return false;
+}
+
+#endif
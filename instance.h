@@ -0,0 +1,218 @@
+#ifndef INSTANCE_H
+#define INSTANCE_H
+
+#include "rt.h"
+
+#include "aabb.h"
+#include "bvh.h"
+#include "hittable.h"
+#include "hittable_list.h"
+#include "obj_loader.h"
+#include "triangle_mesh.h"
+
+#include <array>
+#include <functional>
+#include <set>
+#include <vector>
+
+class transform {
+    // An affine transform: a 3x3 linear part and a translation, stored as the rows of a 3x4
+    // matrix acting on column vectors.
+public:
+    double m[3][4] = { { 1, 0, 0, 0 }, { 0, 1, 0, 0 }, { 0, 0, 1, 0 } };
+
+    static transform translate(const vec3& offset) {
+        transform t;
+        for (int row = 0; row < 3; row++)
+            t.m[row][3] = offset[row];
+        return t;
+    }
+
+    static transform scale(double factor) {
+        transform t;
+        for (int row = 0; row < 3; row++)
+            t.m[row][row] = factor;
+        return t;
+    }
+
+    static transform rotate_y(double degrees) {
+        auto radians = degrees_to_radians(degrees);
+        transform t;
+        t.m[0][0] = std::cos(radians);
+        t.m[0][2] = std::sin(radians);
+        t.m[2][0] = -std::sin(radians);
+        t.m[2][2] = std::cos(radians);
+        return t;
+    }
+
+    // The transform that applies b first, then this one.
+    transform operator*(const transform& b) const {
+        transform result;
+        for (int row = 0; row < 3; row++) {
+            for (int col = 0; col < 4; col++) {
+                result.m[row][col] = m[row][0] * b.m[0][col] + m[row][1] * b.m[1][col]
+                    + m[row][2] * b.m[2][col] + (col == 3 ? m[row][3] : 0.0);
+            }
+        }
+        return result;
+    }
+
+    point3 point(const point3& p) const {
+        return point3(m[0][0] * p.x() + m[0][1] * p.y() + m[0][2] * p.z() + m[0][3],
+                      m[1][0] * p.x() + m[1][1] * p.y() + m[1][2] * p.z() + m[1][3],
+                      m[2][0] * p.x() + m[2][1] * p.y() + m[2][2] * p.z() + m[2][3]);
+    }
+
+    vec3 vector(const vec3& v) const {
+        return vec3(m[0][0] * v.x() + m[0][1] * v.y() + m[0][2] * v.z(),
+                    m[1][0] * v.x() + m[1][1] * v.y() + m[1][2] * v.z(),
+                    m[2][0] * v.x() + m[2][1] * v.y() + m[2][2] * v.z());
+    }
+
+    // Maps a normal through the transform whose inverse this is (the inverse transpose rule).
+    vec3 normal_from_inverse(const vec3& n) const {
+        return vec3(m[0][0] * n.x() + m[1][0] * n.y() + m[2][0] * n.z(),
+                    m[0][1] * n.x() + m[1][1] * n.y() + m[2][1] * n.z(),
+                    m[0][2] * n.x() + m[1][2] * n.y() + m[2][2] * n.z());
+    }
+
+    transform inverse() const {
+        // Inverse of the linear part by cofactors; the translation is then undone through it.
+        auto cofactor = [&](int r0, int r1, int c0, int c1) {
+            return m[r0][c0] * m[r1][c1] - m[r0][c1] * m[r1][c0];
+        };
+        double det = m[0][0] * cofactor(1, 2, 1, 2) - m[0][1] * cofactor(1, 2, 0, 2)
+                   + m[0][2] * cofactor(1, 2, 0, 1);
+        auto inv_det = 1.0 / det;
+
+        transform result;
+        result.m[0][0] = cofactor(1, 2, 1, 2) * inv_det;
+        result.m[0][1] = -cofactor(0, 2, 1, 2) * inv_det;
+        result.m[0][2] = cofactor(0, 1, 1, 2) * inv_det;
+        result.m[1][0] = -cofactor(1, 2, 0, 2) * inv_det;
+        result.m[1][1] = cofactor(0, 2, 0, 2) * inv_det;
+        result.m[1][2] = -cofactor(0, 1, 0, 2) * inv_det;
+        result.m[2][0] = cofactor(1, 2, 0, 1) * inv_det;
+        result.m[2][1] = -cofactor(0, 2, 0, 1) * inv_det;
+        result.m[2][2] = cofactor(0, 1, 0, 1) * inv_det;
+
+        auto offset = result.vector(vec3(m[0][3], m[1][3], m[2][3]));
+        for (int row = 0; row < 3; row++)
+            result.m[row][3] = -offset[row];
+        return result;
+    }
+
+    aabb box(const aabb& b) const {
+        // Bounds of the transformed box (Arvo's method): each output axis takes the smaller and
+        // larger of every linear term separately.
+        interval axes[3];
+        for (int row = 0; row < 3; row++) {
+            double low = m[row][3], high = m[row][3];
+            for (int col = 0; col < 3; col++) {
+                auto a = m[row][col] * b.axis_interval(col).min;
+                auto c = m[row][col] * b.axis_interval(col).max;
+                low += std::min(a, c);
+                high += std::max(a, c);
+            }
+            axes[row] = interval(low, high);
+        }
+        return aabb(axes[0], axes[1], axes[2]);
+    }
+};
+
+class instance : public hittable {
+    // One placement of a shared object (normally a triangle_mesh, which carries its own BVH) in the
+    // world. Rays are moved into object space rather than the object into world space, so the
+    // object and its BVH exist once however many instances use it. The direction is
+    // transformed without normalizing, so hit distances are the same in both spaces.
+public:
+    // If set, update(time) moves the instance to motion(time); the object itself is shared and
+    // is never updated through an instance.
+    std::function<transform(double)> motion;
+
+    instance(shared_ptr<hittable> object, const transform& object_to_world)
+        : object(object) {
+        set_transform(object_to_world);
+    }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        ray object_ray(world_to_object.point(r.origin()), world_to_object.vector(r.direction()), r.time());
+        if (!object->hit(object_ray, ray_t, rec))
+            return false;
+
+        // A linear map keeps the sign of dot(direction, normal), so front_face still holds.
+        rec.p = r.rayPos(rec.t);
+        rec.normal = unit_vector(world_to_object.normal_from_inverse(rec.normal));
+        return true;
+    }
+
+    bool occluded(const ray& r, interval ray_t) const override {
+        ray object_ray(world_to_object.point(r.origin()), world_to_object.vector(r.direction()), r.time());
+        return object->occluded(object_ray, ray_t);
+    }
+
+    aabb bounding_box() const override { return bbox; }
+
+    void update(double time) override {
+        if (motion)
+            set_transform(motion(time));
+    }
+
+    void set_transform(const transform& object_to_world) {
+        to_world = object_to_world;
+        world_to_object = object_to_world.inverse();
+        bbox = to_world.box(object->bounding_box());
+    }
+
+private:
+    shared_ptr<hittable> object;
+    transform to_world;
+    transform world_to_object;
+    aabb bbox;
+};
+
+class instanced_mesh {
+    // A triangle mesh meant to be placed many times. The mesh and its BVH exist once and are
+    // shared by every instance, so a hundred placements cost a hundred instances in the
+    // top-level tree rather than a hundred copies of the mesh.
+    //
+    // Very small meshes are flattened instead: their triangles are transformed once at
+    // placement and added to the top-level list directly. For a handful of triangles that is
+    // cheaper than a ray transform plus a second tree per visit, and the memory is negligible.
+public:
+    static constexpr size_t flatten_limit = 16;  // Meshes up to this many triangles are copied
+
+    instanced_mesh(shared_ptr<triangle_mesh> mesh) : mesh(mesh) {}
+
+    // Adds one placement to a world (or top-level) list and returns the instance, or null if the
+    // placement was flattened.
+    shared_ptr<instance> place(hittable_list& world, const transform& object_to_world) const {
+        if (flattened()) {
+            // A spatial-split build may list a triangle in two leaves; it is copied once.
+            std::set<std::array<double, 9>> copied;
+            for (size_t n = 0; n < mesh->reference_count(); n++) {
+                point3 corners[3] = { mesh->vertex(n, 0), mesh->vertex(n, 1), mesh->vertex(n, 2) };
+                std::array<double, 9> key;
+                for (int i = 0; i < 9; i++)
+                    key[i] = corners[i / 3][i % 3];
+                if (!copied.insert(key).second)
+                    continue;
+                world.add(make_shared<Triangle>(object_to_world.point(corners[0]),
+                    object_to_world.point(corners[1]), object_to_world.point(corners[2]), mesh->material_index()));
+            }
+            return nullptr;
+        }
+        auto placed = make_shared<instance>(mesh, object_to_world);
+        world.add(placed);
+        return placed;
+    }
+
+    bool flattened() const { return mesh->triangle_count() <= flatten_limit; }
+    size_t triangle_count() const { return mesh->triangle_count(); }
+    aabb bounding_box() const { return mesh->bounding_box(); }
+
+private:
+    shared_ptr<triangle_mesh> mesh;  // Object space
+};
+
+#endif
@@ -0,0 +1,288 @@
+#ifndef LBVH_BUILDER_H
+#define LBVH_BUILDER_H
+
+#include "rt.h"
+
+#include "aabb.h"
+#include "bvh_builder.h"
+#include "thread_pool.h"
+
+#include <array>
+#include <memory>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+class lbvh_builder {
+    // Linear BVH (Karras, "Maximizing Parallelism in the Construction of BVHs, Octrees, and k-d
+    // Trees", 2012). Primitives are sorted along a Morton curve through their centroids and the
+    // tree is read off the sorted codes: internal node i covers a run of codes around position
+    // i that share a prefix, and splits it where the next bit changes. Every internal node
+    // finds its run and split on its own, so the codes, the radix sort and the hierarchy are
+    // all computed in parallel; only the final depth-first emission into flat_bvh_node order
+    // (which also computes the bounds) is serial. The splits ignore primitive sizes, so the
+    // tree traces slower than a SAH one, but it builds in a fraction of the time, which suits
+    // scenes that are rebuilt every frame.
+public:
+    static constexpr size_t min_parallel_size = 1 << 15;  // Smaller inputs are built serially
+
+    // A parallel build runs on workers if given, else on a pool of its own for the one build.
+    lbvh_builder(std::vector<bvh_prim_ref>& refs, const bvh_build_options& options,
+        thread_pool* workers = nullptr)
+        : refs(refs), options(options), workers(workers) {}
+
+    // Same contract as bvh_builder::build: returns the flattened tree and leaves refs in leaf
+    // order.
+    std::vector<flat_bvh_node> build() {
+        std::vector<flat_bvh_node> nodes;
+        if (refs.empty())
+            return nodes;
+
+        int threads = options.build_threads > 0 ? options.build_threads : thread_pool::default_thread_count();
+        if (threads > 1 && refs.size() >= min_parallel_size) {
+            if (!workers) {
+                own_pool = std::make_unique<thread_pool>(threads);
+                workers = own_pool.get();
+            }
+            pool = workers;
+            chunk_count = 4 * size_t(pool->thread_count());
+        }
+
+        compute_codes();
+        radix_sort();
+
+        std::vector<bvh_prim_ref> sorted(refs.size());
+        for_chunks(refs.size(), [&](size_t, size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+                sorted[i] = refs[order[i]];
+        });
+        refs.swap(sorted);
+
+        splits.resize(refs.size() - 1);
+        for_chunks(splits.size(), [&](size_t, size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+                splits[i] = find_split(int64_t(i));
+        });
+
+        leaf_limit = size_t(std::clamp(options.max_leaf_size, 1, 0xffff));
+        nodes.reserve(2 * refs.size() - 1);
+        emit(nodes, 0, uint32_t(refs.size() - 1), 0);
+        return nodes;
+    }
+
+private:
+    static constexpr int bits_per_axis = 10;  // 30-bit Morton codes: a 1024^3 grid
+    static constexpr int radix_bits = 11;     // Three radix sort passes over 30 bits
+
+    std::vector<bvh_prim_ref>& refs;
+    bvh_build_options options;
+    thread_pool* workers;                  // Pool to build on, if the caller keeps one
+    std::unique_ptr<thread_pool> own_pool; // Started for this build when the caller has none
+    thread_pool* pool = nullptr;           // Pool of a parallel build; null when serial
+    size_t chunk_count = 1;
+    size_t leaf_limit = 1;
+    std::vector<uint32_t> codes;
+    std::vector<uint32_t> order;    // Sorted position -> index into refs
+    std::vector<uint32_t> splits;   // Internal node i splits after this sorted position
+
+    template <typename F>
+    void for_chunks(size_t count, F&& body) {
+        // Calls body(chunk, begin, end) over chunk_count contiguous chunks of [0, count), on the
+        // pool if there is one. Chunk boundaries depend only on count, so passes over the same
+        // array agree on them.
+        if (!pool) {
+            body(size_t(0), size_t(0), count);
+            return;
+        }
+        pool->parallel_for(chunk_count, [&](size_t chunk, int) {
+            body(chunk, chunk * count / chunk_count, (chunk + 1) * count / chunk_count);
+        });
+    }
+
+    void compute_codes() {
+        // Seeded from the first centroid: aabb::empty is a point at the origin, not an inverted
+        // box, and would stretch the grid to include the origin.
+        aabb centroid_bounds = aabb::empty;
+        for (size_t i = 0; i < refs.size(); i++) {
+            aabb point(refs[i].centroid, refs[i].centroid);
+            centroid_bounds = i == 0 ? point : aabb(centroid_bounds, point);
+        }
+
+        double min[3], scale[3];
+        for (int axis = 0; axis < 3; axis++) {
+            const auto& extent = centroid_bounds.axis_interval(axis);
+            min[axis] = extent.min;
+            scale[axis] = extent.size() > 0 ? double(1 << bits_per_axis) / extent.size() : 0.0;
+        }
+
+        codes.resize(refs.size());
+        order.resize(refs.size());
+        for_chunks(refs.size(), [&](size_t, size_t begin, size_t end) {
+            const uint32_t top = (1 << bits_per_axis) - 1;
+            for (size_t i = begin; i < end; i++) {
+                uint32_t cell[3];
+                for (int axis = 0; axis < 3; axis++) {
+                    auto q = (refs[i].centroid[axis] - min[axis]) * scale[axis];
+                    cell[axis] = uint32_t(std::clamp(q, 0.0, double(top)));
+                }
+                codes[i] = (spread_bits(cell[0]) << 2) | (spread_bits(cell[1]) << 1) | spread_bits(cell[2]);
+                order[i] = uint32_t(i);
+            }
+        });
+    }
+
+    static uint32_t spread_bits(uint32_t v) {
+        // Inserts two zero bits above each of the low 10 bits.
+        v &= 0x3ff;
+        v = (v | v << 16) & 0x030000ff;
+        v = (v | v << 8) & 0x0300f00f;
+        v = (v | v << 4) & 0x030c30c3;
+        v = (v | v << 2) & 0x09249249;
+        return v;
+    }
+
+    void radix_sort() {
+        // Stable LSD radix sort of (code, index) pairs, radix_bits per pass. Each chunk counts its
+        // digits, the counts are prefix-summed digit-major so every chunk knows where its keys
+        // go, and the chunks then scatter in parallel. Passes where every key has the same digit
+        // are skipped.
+        constexpr uint32_t digits = 1 << radix_bits;
+        std::vector<uint32_t> code_buffer(codes.size());
+        std::vector<uint32_t> order_buffer(order.size());
+        std::vector<std::array<size_t, digits>> counts(chunk_count);
+
+        for (int shift = 0; shift < 3 * bits_per_axis; shift += radix_bits) {
+            for_chunks(codes.size(), [&](size_t chunk, size_t begin, size_t end) {
+                auto& count = counts[chunk];
+                count.fill(0);
+                for (size_t i = begin; i < end; i++)
+                    count[(codes[i] >> shift) & (digits - 1)]++;
+            });
+
+            size_t sum = 0;
+            bool single_digit = false;
+            for (uint32_t digit = 0; digit < digits; digit++) {
+                size_t digit_total = 0;
+                for (auto& count : counts) {
+                    auto n = count[digit];
+                    count[digit] = sum;
+                    sum += n;
+                    digit_total += n;
+                }
+                single_digit = single_digit || digit_total == codes.size();
+            }
+            if (single_digit)
+                continue;
+
+            for_chunks(codes.size(), [&](size_t chunk, size_t begin, size_t end) {
+                auto& next = counts[chunk];
+                for (size_t i = begin; i < end; i++) {
+                    auto slot = next[(codes[i] >> shift) & (digits - 1)]++;
+                    code_buffer[slot] = codes[i];
+                    order_buffer[slot] = order[i];
+                }
+            });
+            codes.swap(code_buffer);
+            order.swap(order_buffer);
+        }
+    }
+
+    int common_prefix(int64_t i, int64_t j) const {
+        // Length of the common prefix of the keys at sorted positions i and j, or -1 if j is out
+        // of range. Equal codes are told apart by their positions, as if appended to the code.
+        if (j < 0 || j >= int64_t(codes.size()))
+            return -1;
+        auto difference = codes[i] ^ codes[j];
+        if (difference)
+            return leading_zeros(difference);
+        return 32 + leading_zeros(uint32_t(i ^ j));
+    }
+
+    uint32_t find_split(int64_t i) const {
+        // Internal node i covers [i, j] or [j, i]: it extends in the direction whose neighbour
+        // shares the longer prefix, as far as the prefix stays longer than the one shared with
+        // the neighbour on the other side. Both ends and the split are found by binary search.
+        int64_t direction = common_prefix(i, i + 1) > common_prefix(i, i - 1) ? 1 : -1;
+        int min_prefix = common_prefix(i, i - direction);
+
+        int64_t max_length = 2;
+        while (common_prefix(i, i + max_length * direction) > min_prefix)
+            max_length *= 2;
+
+        int64_t length = 0;
+        for (int64_t step = max_length / 2; step >= 1; step /= 2) {
+            if (common_prefix(i, i + (length + step) * direction) > min_prefix)
+                length += step;
+        }
+        int64_t j = i + length * direction;
+
+        // The split is the last position that still shares more than node_prefix bits with i.
+        int node_prefix = common_prefix(i, j);
+        int64_t split = 0;
+        for (int64_t divisor = 2;; divisor *= 2) {
+            auto step = (length + divisor - 1) / divisor;
+            if (common_prefix(i, i + (split + step) * direction) > node_prefix)
+                split += step;
+            if (step == 1)
+                break;
+        }
+        return uint32_t(i + split * direction + std::min<int64_t>(direction, 0));
+    }
+
+    uint32_t emit(std::vector<flat_bvh_node>& nodes, uint32_t first, uint32_t last, uint32_t internal) {
+        // Appends the subtree of internal node `internal`, which covers sorted positions
+        // [first, last], in depth-first order and returns its index. In Karras' numbering the
+        // children of a node splitting after position s are internal nodes s and s + 1.
+        auto index = uint32_t(nodes.size());
+        nodes.emplace_back();
+
+        if (last - first + 1 <= leaf_limit) {
+            aabb box = refs[first].box;
+            for (uint32_t i = first + 1; i <= last; i++)
+                box = aabb(box, refs[i].box);
+
+            auto& node = nodes[index];
+            for (int axis = 0; axis < 3; axis++) {
+                node.bounds_min[axis] = bvh_builder::round_down(box.axis_interval(axis).min);
+                node.bounds_max[axis] = bvh_builder::round_up(box.axis_interval(axis).max);
+            }
+            node.offset = first;
+            node.primitive_count = uint16_t(last - first + 1);
+            return index;
+        }
+
+        auto split = splits[internal];
+        emit(nodes, first, split, split);
+        auto second = emit(nodes, split + 1, last, split + 1);
+
+        // The children's bounds are already rounded outwards, so their union is exact.
+        auto& node = nodes[index];
+        const auto& left = nodes[index + 1];
+        const auto& right = nodes[second];
+        for (int axis = 0; axis < 3; axis++) {
+            node.bounds_min[axis] = std::min(left.bounds_min[axis], right.bounds_min[axis]);
+            node.bounds_max[axis] = std::max(left.bounds_max[axis], right.bounds_max[axis]);
+        }
+        node.offset = second;
+        node.primitive_count = 0;
+
+        // The highest bit where the codes either side of the split differ says which axis the
+        // split is on; codes interleave x, y, z from the top.
+        auto difference = codes[split] ^ codes[split + 1];
+        node.axis = uint16_t(difference ? 2 - (31 - leading_zeros(difference)) % 3 : 0);
+        return index;
+    }
+
+    static int leading_zeros(uint32_t x) {
+#if defined(_MSC_VER)
+        unsigned long bit;
+        return _BitScanReverse(&bit, x) ? 31 - int(bit) : 32;
+#else
+        return x ? __builtin_clz(x) : 32;
+#endif
+    }
+};
+
+#endif
@@ -3,23 +3,33 @@
 
 #include "rt.h"
 
-class hit_record;
+#include "hittable.h"
+
+#include <unordered_map>
+#include <vector>
 
 class material {
 public:
     virtual ~material() = default;
 
     virtual bool scatter(
-        const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered
+        const ray& /*r_in*/, const hit_record& /*rec*/, color& /*attenuation*/, ray& /*scattered*/
     ) const {
         return false;
     }
+
+    // True if other scatters exactly as this material does, so a scene needs only one of them.
+    // Materials that cannot tell only match themselves.
+    virtual bool same_as(const material& other) const { return this == &other; }
+
+    // Equal for materials that are the same_as each other.
+    virtual uint64_t hash() const { return uint64_t(std::hash<const material*>()(this)); }
 };
 
 class lambertian : public material {
 public:
-    lambertian(const color& albedo) : texture(make_shared<solid_color>(albedo)) {}
-    lambertian(shared_ptr<texture> tex) : texture(tex) {}
+    lambertian(const color& albedo) : albedo(albedo), tex(make_shared<solid_color>(albedo)), solid(true) {}
+    lambertian(shared_ptr<texture> tex) : tex(tex), solid(is_solid_color(*tex, albedo)) {}
 
     bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered)
         const override {
@@ -29,13 +39,21 @@ public:
             scatter_direction = rec.normal;
 
         scattered = ray(rec.p, scatter_direction, r_in.time());
-        attenuation = texture->value(rec.u, rec.v, rec.p);
+        attenuation = solid ? albedo : tex->value(rec.u, rec.v, rec.p);
         return true;
     }
 
+    bool same_as(const material& other) const override {
+        auto diffuse = dynamic_cast<const lambertian*>(&other);
+        return diffuse && tex->same_as(*diffuse->tex);
+    }
+
+    uint64_t hash() const override { return hash_combine(2, tex->hash()); }
+
 private:
-    color albedo;
-    shared_ptr<texture> texture;
+    color albedo;  // The texture's color, if it is a solid one
+    shared_ptr<texture> tex;
+    bool solid;
 };
 
 class metal : public material {
@@ -51,6 +69,15 @@ public:
         return (dot(scattered.direction(), rec.normal) > 0);
     }
 
+    bool same_as(const material& other) const override {
+        auto shiny = dynamic_cast<const metal*>(&other);
+        return shiny && albedo == shiny->albedo && fuzz == shiny->fuzz;
+    }
+
+    uint64_t hash() const override {
+        return hash_combine(hash_combine(hash_combine(hash_combine(3, albedo.x()), albedo.y()), albedo.z()), fuzz);
+    }
+
 private:
     color albedo;
     double fuzz;
@@ -72,7 +99,7 @@ public:
         bool cannot_refract = ri * sin_theta > 1.0;
         vec3 direction;
 
-        if (cannot_refract || reflectance(cos_theta, ri) > RandomGenerator::instance().random_double())
+        if (cannot_refract || reflectance(cos_theta, ri) > random_double())
             direction = reflect(unit_direction, rec.normal);
         else
             direction = refract(unit_direction, rec.normal, ri);
@@ -81,6 +108,13 @@ public:
         return true;
     }
 
+    bool same_as(const material& other) const override {
+        auto glass = dynamic_cast<const dielectric*>(&other);
+        return glass && refraction_index == glass->refraction_index;
+    }
+
+    uint64_t hash() const override { return hash_combine(4, refraction_index); }
+
 private:
     // Refractive index in vacuum or air, or the ratio of the material's refractive index over
     // the refractive index of the enclosing media
@@ -94,4 +128,37 @@ private:
     }
 };
 
-#endif
\ No newline at end of file
+class material_table {
+    // The scene's materials, addressed by material_id. Primitives and hit records carry the
+    // 32-bit ID instead of a shared_ptr, so accepting a hit copies an integer rather than
+    // touching a reference count that every thread shares, and the renderer looks the material
+    // up once per bounce. add() hands back the ID of an equal material already in the table,
+    // so a scene that makes the same material many times keeps one copy.
+public:
+    material_id add(shared_ptr<material> mat) {
+        added_count++;
+        auto key = mat->hash();
+        auto candidates = by_hash.equal_range(key);
+        for (auto match = candidates.first; match != candidates.second; ++match) {
+            if (materials[match->second]->same_as(*mat))
+                return match->second;
+        }
+
+        auto id = material_id(materials.size());
+        materials.push_back(mat);
+        by_hash.emplace(key, id);
+        return id;
+    }
+
+    const material& operator[](material_id id) const { return *materials[id]; }
+
+    size_t size() const { return materials.size(); }
+    size_t added() const { return added_count; }  // Materials passed to add(), before merging
+
+private:
+    std::vector<shared_ptr<material>> materials;
+    std::unordered_multimap<uint64_t, material_id> by_hash;
+    size_t added_count = 0;
+};
+
+#endif
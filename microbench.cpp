@@ -0,0 +1,458 @@
+#include "rt.h"
+
+#include "benchmark.h"
+#include "bvh.h"
+#include "hittable.h"
+#include "hittable_list.h"
+#include "instance.h"
+#include "material.h"
+#include "obj_loader.h"
+#include "perlin.h"
+#include "scenes.h"
+#include "sphere.h"
+#include "triangle_mesh.h"
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+// Microbenchmarks for the intersection and shading kernels. Every input is generated from a
+// fixed seed, so two runs (or two builds) time exactly the same work.
+//
+// Each intersection kernel is timed with two ray distributions:
+//   coherent   - primary rays from a pinhole camera in scanline order; neighbouring rays take
+//                the same path through the code and the tree.
+//   incoherent - rays with unrelated origins and directions, like diffuse bounces.
+//
+// Build: g++ -std=c++17 -O2 -pthread microbench.cpp -o rt_microbench
+// Usage: rt_microbench [--filter SUBSTRING] [--min-time SECONDS] [--repetitions N] [--seed N]
+
+constexpr size_t ray_count = 1 << 14;  // Rays per batch: large enough to leave L1, small enough for L2
+
+std::vector<ray> primary_rays(const point3& lookfrom, const point3& lookat, double vfov, size_t count) {
+    // A square pinhole camera image in scanline order, one ray per pixel centre.
+    auto side = size_t(std::sqrt(double(count)));
+    auto h = std::tan(degrees_to_radians(vfov) / 2);
+    vec3 w = unit_vector(lookfrom - lookat);
+    vec3 u = unit_vector(cross(vec3(0, 1, 0), w));
+    vec3 v = cross(w, u);
+
+    std::vector<ray> rays;
+    rays.reserve(side * side);
+    for (size_t j = 0; j < side; j++) {
+        for (size_t i = 0; i < side; i++) {
+            auto x = (2 * (i + 0.5) / side - 1) * h;
+            auto y = (1 - 2 * (j + 0.5) / side) * h;
+            rays.emplace_back(lookfrom, x * u + y * v - w);
+        }
+    }
+    return rays;
+}
+
+point3 box_center(const aabb& box) {
+    return point3(box.axis_interval(0).min + box.axis_interval(0).max,
+                  box.axis_interval(1).min + box.axis_interval(1).max,
+                  box.axis_interval(2).min + box.axis_interval(2).max) / 2;
+}
+
+vec3 box_half_size(const aabb& box) {
+    return vec3(box.axis_interval(0).size(), box.axis_interval(1).size(),
+                box.axis_interval(2).size()) / 2;
+}
+
+std::vector<ray> coherent_rays(const aabb& box, size_t count) {
+    // Looks at the box from a little off-axis so that the view covers it with some margin.
+    auto center = box_center(box);
+    auto radius = std::fmax(box_half_size(box).length(), 1e-3);
+
+    auto lookfrom = center + 4 * radius * unit_vector(vec3(0.3, 0.4, 1));
+    auto vfov = 2 * std::atan(0.75 / 4) / degrees_to_radians_factor;
+    return primary_rays(lookfrom, center, vfov, count);
+}
+
+std::vector<ray> incoherent_rays(const aabb& box, size_t count) {
+    // Origins spread over a sphere around the box, each aimed at an unrelated point in a region
+    // twice the size of the box, so consecutive rays share neither origin nor direction.
+    auto center = box_center(box);
+    auto half = box_half_size(box);
+    auto radius = std::fmax(half.length(), 1e-3);
+
+    std::vector<ray> rays;
+    rays.reserve(count);
+    for (size_t n = 0; n < count; n++) {
+        auto origin = center + 3 * radius * random_unit_vector();
+        point3 target(center.x() + 2 * half.x() * random_double(-1, 1),
+                      center.y() + 2 * half.y() * random_double(-1, 1),
+                      center.z() + 2 * half.z() * random_double(-1, 1));
+        rays.emplace_back(origin, target - origin);
+    }
+    return rays;
+}
+
+std::vector<ray> diffuse_rays(const hittable& world, const std::vector<ray>& primary) {
+    // Secondary rays as the renderer makes them: cosine-distributed about the normal at each
+    // primary hit point.
+    std::vector<ray> rays;
+    rays.reserve(primary.size());
+    hit_record rec;
+    for (const auto& r : primary) {
+        if (world.hit(r, interval(0.001, infinity), rec))
+            rays.emplace_back(rec.p, rec.normal + random_unit_vector());
+    }
+    return rays;
+}
+
+std::vector<shared_ptr<hittable>> sphere_mesh(const point3& center, double radius, int slices,
+    int stacks, material_id mat) {
+    // A UV sphere tessellated into 2 * slices * (stacks - 1) triangles.
+    auto vertex = [&](int i, int j) {
+        auto phi = 2 * pi * i / slices;
+        auto theta = pi * j / stacks;
+        return center + radius * vec3(std::sin(theta) * std::cos(phi), std::cos(theta),
+            std::sin(theta) * std::sin(phi));
+    };
+
+    std::vector<shared_ptr<hittable>> triangles;
+    for (int j = 0; j < stacks; j++) {
+        for (int i = 0; i < slices; i++) {
+            auto a = vertex(i, j), b = vertex(i + 1, j);
+            auto c = vertex(i, j + 1), d = vertex(i + 1, j + 1);
+            if (j != 0)
+                triangles.push_back(make_shared<Triangle>(a, b, d, mat));
+            if (j != stacks - 1)
+                triangles.push_back(make_shared<Triangle>(a, d, c, mat));
+        }
+    }
+    return triangles;
+}
+
+shared_ptr<triangle_mesh> indexed_sphere_mesh(const point3& center, double radius, int slices,
+    int stacks, material_id mat) {
+    // The triangles of sphere_mesh, as one mesh built from a shared vertex grid.
+    std::vector<point3> vertices;
+    for (int j = 0; j <= stacks; j++) {
+        for (int i = 0; i <= slices; i++) {
+            auto phi = 2 * pi * i / slices;
+            auto theta = pi * j / stacks;
+            vertices.push_back(center + radius * vec3(std::sin(theta) * std::cos(phi), std::cos(theta),
+                std::sin(theta) * std::sin(phi)));
+        }
+    }
+
+    auto index = [&](int i, int j) { return uint32_t(j * (slices + 1) + i); };
+    std::vector<uint32_t> indices;
+    for (int j = 0; j < stacks; j++) {
+        for (int i = 0; i < slices; i++) {
+            if (j != 0)
+                indices.insert(indices.end(), { index(i, j), index(i + 1, j), index(i + 1, j + 1) });
+            if (j != stacks - 1)
+                indices.insert(indices.end(), { index(i, j), index(i + 1, j + 1), index(i, j + 1) });
+        }
+    }
+    return make_shared<triangle_mesh>(std::move(vertices), std::move(indices), mat);
+}
+
+std::vector<shared_ptr<hittable>> fan_mesh(const point3& center, double radius, int rings, int segments,
+    material_id mat) {
+    // A tilted disk of concentric rings, each cut into long thin triangles that run around it:
+    // the kind of geometry whose boxes overlap badly under object splits.
+    auto tilt = transform::rotate_y(30) * transform::translate(vec3(center));
+    auto vertex = [&](int ring, int i) {
+        auto phi = 2 * pi * i / segments;
+        auto r = radius * (ring + 1) / rings;
+        return tilt.point(point3(r * std::cos(phi), 0.5 * r * std::cos(phi), r * std::sin(phi)));
+    };
+
+    std::vector<shared_ptr<hittable>> triangles;
+    for (int ring = 0; ring + 1 < rings; ring++) {
+        for (int i = 0; i < segments; i++) {
+            // Each triangle spans a quarter turn, so it overlaps its neighbours' boxes.
+            int j = i + segments / 4;
+            triangles.push_back(make_shared<Triangle>(vertex(ring, i), vertex(ring + 1, i), vertex(ring + 1, j), mat));
+        }
+    }
+    return triangles;
+}
+
+void bench_hits(benchmark_suite& suite, const std::string& name, const hittable& object,
+    const std::vector<ray>& rays) {
+    suite.run(name, rays.size(), "rays", [&] {
+        hit_record rec;
+        size_t hits = 0;
+        for (const auto& r : rays)
+            hits += object.hit(r, interval(0.001, infinity), rec);
+        return hits;
+    });
+}
+
+void bench_occluded(benchmark_suite& suite, const std::string& name, const hittable& object,
+    const std::vector<ray>& rays) {
+    suite.run(name, rays.size(), "rays", [&] {
+        size_t hits = 0;
+        for (const auto& r : rays)
+            hits += object.occluded(r, interval(0.001, infinity));
+        return hits;
+    });
+}
+
+void bench_box_hits(benchmark_suite& suite, const std::string& name, const aabb& box,
+    const std::vector<ray>& rays) {
+    suite.run(name, rays.size(), "rays", [&] {
+        size_t hits = 0;
+        for (const auto& r : rays)
+            hits += box.hit(r, interval(0.001, infinity));
+        return hits;
+    });
+}
+
+void bench_scatter(benchmark_suite& suite, const std::string& name, const material& mat,
+    const std::vector<ray>& rays, const std::vector<hit_record>& records) {
+    suite.run(name, records.size(), "calls", [&] {
+        color attenuation;
+        ray scattered;
+        size_t scatters = 0;
+        for (size_t n = 0; n < records.size(); n++)
+            scatters += mat.scatter(rays[n], records[n], attenuation, scattered);
+        return scatters;
+    });
+}
+
+int main(int argc, char* argv[]) {
+    benchmark_suite suite;
+    uint64_t seed = 1;
+
+    for (int arg = 1; arg < argc; arg++) {
+        std::string option = argv[arg];
+        if (arg + 1 >= argc) {
+            std::cerr << "Missing value for option: " << option << std::endl;
+            return 1;
+        }
+        else if (option == "--filter")
+            suite.filter = argv[++arg];
+        else if (option == "--min-time")
+            suite.min_time = std::atof(argv[++arg]);
+        else if (option == "--repetitions")
+            suite.repetitions = std::atoi(argv[++arg]);
+        else if (option == "--seed")
+            seed = std::stoull(argv[++arg]);
+        else {
+            std::cerr << "Unknown option: " << option << std::endl;
+            return 1;
+        }
+    }
+
+    seed_random(seed);
+
+    material_table materials;
+    auto gray = materials.add(make_shared<lambertian>(color(0.5, 0.5, 0.5)));
+
+    // sphere::hit and aabb::hit on a unit sphere and its box.
+    sphere ball(point3(0, 0, 0), 1.0, gray);
+    auto ball_coherent = coherent_rays(ball.bounding_box(), ray_count);
+    auto ball_incoherent = incoherent_rays(ball.bounding_box(), ray_count);
+    bench_hits(suite, "sphere::hit/coherent", ball, ball_coherent);
+    bench_hits(suite, "sphere::hit/incoherent", ball, ball_incoherent);
+
+    sphere moving_ball(point3(0, 0, 0), point3(0, 0.5, 0), 1.0, gray);
+    bench_hits(suite, "sphere::hit/moving/incoherent", moving_ball, ball_incoherent);
+
+    bench_box_hits(suite, "aabb::hit/coherent", ball.bounding_box(), ball_coherent);
+    bench_box_hits(suite, "aabb::hit/incoherent", ball.bounding_box(), ball_incoherent);
+
+    // Triangle::hit on one triangle tilted out of the axis planes.
+    Triangle tri(point3(-1, -0.8, 0.2), point3(1, -0.6, -0.3), point3(0.1, 1, 0.1), gray);
+    bench_hits(suite, "Triangle::hit/coherent", tri, coherent_rays(tri.bounding_box(), ray_count));
+    bench_hits(suite, "Triangle::hit/incoherent", tri, incoherent_rays(tri.bounding_box(), ray_count));
+
+    // Four triangles around it, tested one at a time with precomputed edges and as one packet.
+    triangle_packet packet;
+    point3 corners[4][3];
+    for (int lane = 0; lane < triangle_packet::width; lane++) {
+        auto turn = transform::rotate_y(90.0 * lane) * transform::scale(1.0 - 0.1 * lane);
+        for (int corner = 0; corner < 3; corner++)
+            corners[lane][corner] = turn.point(tri.vertex(corner));
+        packet.set(lane, corners[lane][0], corners[lane][1], corners[lane][2]);
+    }
+    auto packet_box = aabb(tri.bounding_box(), transform::rotate_y(90).box(tri.bounding_box()));
+    for (auto coherent : { true, false }) {
+        auto rays = coherent ? coherent_rays(packet_box, ray_count) : incoherent_rays(packet_box, ray_count);
+        auto suffix = coherent ? "coherent" : "incoherent";
+        suite.run(std::string("intersect_triangle/x4/") + suffix, rays.size(), "rays", [&] {
+            size_t hits = 0;
+            for (const auto& r : rays) {
+                for (int lane = 0; lane < triangle_packet::width; lane++) {
+                    double t;
+                    hits += intersect_triangle(corners[lane][0], corners[lane][1] - corners[lane][0],
+                        corners[lane][2] - corners[lane][0], r, interval(0.001, infinity), t);
+                }
+            }
+            return hits;
+        });
+        suite.run(std::string("triangle_packet_intersect/") + suffix, rays.size(), "rays", [&] {
+            size_t hits = 0;
+            double t[triangle_packet::width];
+            for (const auto& r : rays) {
+                for (int mask = triangle_packet_intersect(packet, 0xf, r, interval(0.001, infinity), t); mask; mask &= mask - 1)
+                    hits++;
+            }
+            return hits;
+        });
+    }
+
+    // bvh_node::hit on the bouncing_spheres scene, with the scene's own camera for primary rays.
+    // The scene is built from a fresh seed, so the wide variants below get the same layout.
+    scene spheres;
+    seed_random(seed);
+    build_scene("bouncing_spheres", spheres);
+    const hittable& sphere_bvh = *spheres.world.objects[0];
+    auto scene_primary = primary_rays(spheres.cam.lookfrom, spheres.cam.lookat, spheres.cam.vfov,
+        ray_count);
+    bench_hits(suite, "bvh_node::hit/spheres/coherent", sphere_bvh, scene_primary);
+    auto scene_diffuse = diffuse_rays(sphere_bvh, scene_primary);
+    bench_hits(suite, "bvh_node::hit/spheres/incoherent", sphere_bvh, scene_diffuse);
+
+    // bvh_node::hit on a 16k-triangle mesh.
+    hittable_list mesh;
+    for (const auto& triangle : sphere_mesh(point3(0, 0, 0), 1.0, 128, 64, gray))
+        mesh.add(triangle);
+    bvh_node mesh_bvh(mesh);
+    auto mesh_primary = coherent_rays(mesh_bvh.bounding_box(), ray_count);
+    bench_hits(suite, "bvh_node::hit/mesh/coherent", mesh_bvh, mesh_primary);
+    auto mesh_incoherent = incoherent_rays(mesh_bvh.bounding_box(), ray_count);
+    bench_hits(suite, "bvh_node::hit/mesh/incoherent", mesh_bvh, mesh_incoherent);
+
+    // The same triangles as an indexed mesh with its own BVH.
+    auto indexed_mesh = indexed_sphere_mesh(point3(0, 0, 0), 1.0, 128, 64, gray);
+    bench_hits(suite, "triangle_mesh::hit/coherent", *indexed_mesh, mesh_primary);
+    bench_hits(suite, "triangle_mesh::hit/incoherent", *indexed_mesh, mesh_incoherent);
+
+    // The mesh BVH reached through a rotated instance, which adds a ray transform per test.
+    instance mesh_instance(make_shared<bvh_node>(mesh), transform::rotate_y(30));
+    bench_hits(suite, "instance::hit/mesh/coherent", mesh_instance, mesh_primary);
+    bench_hits(suite, "instance::hit/mesh/incoherent", mesh_instance, mesh_incoherent);
+
+    // The any-hit query over the same rays, to compare against the closest-hit rows above.
+    bench_occluded(suite, "bvh_node::occluded/spheres/coherent", sphere_bvh, scene_primary);
+    bench_occluded(suite, "bvh_node::occluded/spheres/incoherent", sphere_bvh, scene_diffuse);
+    bench_occluded(suite, "bvh_node::occluded/mesh/coherent", mesh_bvh, mesh_primary);
+    bench_occluded(suite, "bvh_node::occluded/mesh/incoherent", mesh_bvh, mesh_incoherent);
+    bench_occluded(suite, "triangle_mesh::occluded/coherent", *indexed_mesh, mesh_primary);
+    bench_occluded(suite, "triangle_mesh::occluded/incoherent", *indexed_mesh, mesh_incoherent);
+
+    // Object splits against spatial splits on long, overlapping triangles.
+    hittable_list fan;
+    for (const auto& triangle : fan_mesh(point3(0, 0, 0), 1.0, 32, 256, gray))
+        fan.add(triangle);
+    auto fan_primary = coherent_rays(fan.bounding_box(), ray_count);
+    auto fan_incoherent = incoherent_rays(fan.bounding_box(), ray_count);
+    for (auto split : { bvh_split::sah, bvh_split::sbvh }) {
+        bvh_build_options options;
+        options.split = split;
+        bvh_node fan_bvh(fan, options);
+        auto prefix = std::string("bvh_node::hit/fan/") + bvh_split_name(split) + "/";
+        bench_hits(suite, prefix + "coherent", fan_bvh, fan_primary);
+        bench_hits(suite, prefix + "incoherent", fan_bvh, fan_incoherent);
+    }
+
+    // The same two trees collapsed to 4 and 8 children per node.
+    for (int width : { 4, 8 }) {
+        bvh_build_options options;
+        options.width = width;
+        auto prefix = "bvh_node::hit/" + std::to_string(width) + "-wide/";
+
+        scene wide_spheres;
+        wide_spheres.bvh_options = options;
+        seed_random(seed);
+        build_scene("bouncing_spheres", wide_spheres);
+        bench_hits(suite, prefix + "spheres/coherent", *wide_spheres.bvh, scene_primary);
+        bench_hits(suite, prefix + "spheres/incoherent", *wide_spheres.bvh, scene_diffuse);
+
+        bvh_node wide_mesh(mesh, options);
+        bench_hits(suite, prefix + "mesh/coherent", wide_mesh, mesh_primary);
+        bench_hits(suite, prefix + "mesh/incoherent", wide_mesh, mesh_incoherent);
+    }
+
+    // BVH construction over the same mesh, serial and on all threads; ns per primitive is also
+    // milliseconds per million primitives. The linear builder is also timed on a 260k-triangle
+    // mesh, large enough for its parallel path.
+    hittable_list large_mesh;
+    for (const auto& triangle : sphere_mesh(point3(0, 0, 0), 1.0, 512, 256, gray))
+        large_mesh.add(triangle);
+
+    for (int threads : { 1, 0 }) {
+        bvh_build_options options;
+        options.build_threads = threads;
+        std::string mode = threads == 1 ? "serial" : "parallel";
+        suite.run("bvh_node::build/mesh/" + mode, mesh.objects.size(), "prims", [&] {
+            return bvh_node(mesh, options).node_count() > 0 ? mesh.objects.size() : 0;
+        });
+
+        options.split = bvh_split::lbvh;
+        suite.run("bvh_node::build/mesh/lbvh/" + mode, mesh.objects.size(), "prims", [&] {
+            return bvh_node(mesh, options).node_count() > 0 ? mesh.objects.size() : 0;
+        });
+        suite.run("bvh_node::build/large_mesh/lbvh/" + mode, large_mesh.objects.size(), "prims", [&] {
+            return bvh_node(large_mesh, options).node_count() > 0 ? large_mesh.objects.size() : 0;
+        });
+    }
+
+    // The spatial-split builder is serial.
+    {
+        bvh_build_options options;
+        options.split = bvh_split::sbvh;
+        suite.run("bvh_node::build/mesh/sbvh", mesh.objects.size(), "prims", [&] {
+            return bvh_node(mesh, options).node_count() > 0 ? mesh.objects.size() : 0;
+        });
+        suite.run("bvh_node::build/fan/sbvh", fan.objects.size(), "prims", [&] {
+            return bvh_node(fan, options).node_count() > 0 ? fan.objects.size() : 0;
+        });
+    }
+
+    // bvh_node::update on the large mesh: a refit of the unchanged tree against a full LBVH
+    // rebuild.
+    for (double threshold : { 1e9, 0.0 }) {
+        bvh_build_options options;
+        options.split = bvh_split::lbvh;
+        options.rebuild_threshold = threshold;
+        bvh_node tree(large_mesh, options);
+        suite.run(threshold > 0 ? "bvh_node::update/large_mesh/refit" : "bvh_node::update/large_mesh/rebuild",
+            large_mesh.objects.size(), "prims", [&] {
+                tree.update(0);
+                return large_mesh.objects.size();
+            });
+    }
+
+    // perlin::turb at the depth noise_texture uses.
+    perlin noise;
+    std::vector<point3> noise_points;
+    for (size_t n = 0; n < ray_count; n++)
+        noise_points.push_back(4 * point3(random_double(-1, 1), random_double(-1, 1), random_double(-1, 1)));
+    suite.run("perlin::turb/depth7", noise_points.size(), "calls", [&] {
+        size_t nonzero = 0;
+        for (const auto& p : noise_points)
+            nonzero += noise.turb(p, 7) > 0;
+        return nonzero;
+    });
+
+    // material::scatter on hit records from primary rays on the unit sphere.
+    std::vector<ray> shading_rays;
+    std::vector<hit_record> records;
+    for (const auto& r : ball_coherent) {
+        hit_record rec;
+        if (ball.hit(r, interval(0.001, infinity), rec)) {
+            shading_rays.push_back(r);
+            records.push_back(rec);
+        }
+    }
+
+    bench_scatter(suite, "lambertian::scatter/solid", materials[gray], shading_rays, records);
+    bench_scatter(suite, "lambertian::scatter/checker",
+        lambertian(make_shared<checker_texture>(0.32, color(.2, .3, .1), color(.9, .9, .9))),
+        shading_rays, records);
+    bench_scatter(suite, "lambertian::scatter/noise", lambertian(make_shared<noise_texture>(4)),
+        shading_rays, records);
+    bench_scatter(suite, "metal::scatter", metal(color(0.7, 0.6, 0.5), 0.3), shading_rays, records);
+    bench_scatter(suite, "dielectric::scatter", dielectric(1.5), shading_rays, records);
+
+    return 0;
+}
@@ -5,90 +5,52 @@
 #include "rt.h"
 #include "hittable.h"
 #include "material.h"
+#include "triangle.h"
+#include "triangle_mesh.h"
 #include <vector>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <memory>
 
-class Triangle : public hittable {
+class OBJLoader {
 public:
-    Triangle(const point3& v0, const point3& v1, const point3& v2, shared_ptr<material> mat)
-        : vertex0(v0), vertex1(v1), vertex2(v2), mat_ptr(mat) {
-        normal = unit_vector(cross(vertex1 - vertex0, vertex2 - vertex0));
-    }
-
-    virtual bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
-        // Implement MllerTrumbore intersection algorithm
-        vec3 edge1 = vertex1 - vertex0;
-        vec3 edge2 = vertex2 - vertex0;
-        vec3 h = cross(r.direction(), edge2);
-        double a = dot(edge1, h);
-
-        if (a > -1e-8 && a < 1e-8)
-            return false;
-
-        double f = 1.0 / a;
-        vec3 s = r.origin() - vertex0;
-        double u = f * dot(s, h);
-
-        if (u < 0.0 || u > 1.0)
-            return false;
-
-        vec3 q = cross(s, edge1);
-        double v = f * dot(r.direction(), q);
-
-        if (v < 0.0 || u + v > 1.0)
-            return false;
-
-        double t = f * dot(edge2, q);
+    static std::vector<shared_ptr<hittable>> load_obj(const std::string& filename, material_id mat) {
+        std::vector<shared_ptr<hittable>> triangles;
+        std::vector<point3> vertices;
+        std::vector<uint32_t> indices;
+        if (!read_obj(filename, vertices, indices))
+            return triangles;
 
-        if (t > ray_t.min && t < ray_t.max) {
-            rec.t = t;
-            rec.p = r.rayPos(t);
-            rec.set_face_normal(r, normal);
-            rec.mat = mat_ptr;
-            return true;
+        triangles.reserve(indices.size() / 3);
+        for (size_t i = 0; i < indices.size(); i += 3) {
+            triangles.push_back(make_shared<Triangle>(
+                vertices[indices[i]], vertices[indices[i + 1]], vertices[indices[i + 2]], mat
+            ));
         }
-
-        return false;
+        return triangles;
     }
 
-    aabb bounding_box() const override {
-		point3 min = point3(
-			std::min({ vertex0.x(), vertex1.x(), vertex2.x() }),
-			std::min({ vertex0.y(), vertex1.y(), vertex2.y() }),
-			std::min({ vertex0.z(), vertex1.z(), vertex2.z() })
-		);
-
-		point3 max = point3(
-			std::max({ vertex0.x(), vertex1.x(), vertex2.x() }),
-			std::max({ vertex0.y(), vertex1.y(), vertex2.y() }),
-			std::max({ vertex0.z(), vertex1.z(), vertex2.z() })
-		);
-
-		return aabb(min, max);
-	}
-
-    void update(double time) override {};
+    // Loads the file as one triangle_mesh rather than a Triangle per face; null if it cannot be read.
+    static shared_ptr<triangle_mesh> load_mesh(const std::string& filename, material_id mat,
+        const bvh_build_options& options = {}) {
+        std::vector<point3> vertices;
+        std::vector<uint32_t> indices;
+        if (!read_obj(filename, vertices, indices))
+            return nullptr;
+        return make_shared<triangle_mesh>(std::move(vertices), std::move(indices), mat, options);
+    }
 
 private:
-    point3 vertex0, vertex1, vertex2;
-    vec3 normal;
-    shared_ptr<material> mat_ptr;
-};
-
-class OBJLoader {
-public:
-    static std::vector<shared_ptr<hittable>> load_obj(const std::string& filename, shared_ptr<material> mat) {
-        std::vector<shared_ptr<hittable>> triangles;
-        std::vector<vec3> vertices;
+    static bool read_obj(const std::string& filename, std::vector<point3>& vertices, std::vector<uint32_t>& indices) {
+        // Reads the "v" and "f" lines: vertex positions, and one zero-based index triple per
+        // triangular face. Faces naming a vertex that has not been read are skipped.
         std::ifstream file(filename);
         std::string line;
 
         if (!file.is_open()) {
             std::cerr << "Failed to open file: " << filename << std::endl;
-            return triangles;
+            return false;
         }
 
         while (std::getline(file, line)) {
@@ -102,15 +64,18 @@ public:
                 vertices.emplace_back(x, y, z);
             }
             else if (type == "f") {
-                int v1, v2, v3;
+                long v1, v2, v3;
                 iss >> v1 >> v2 >> v3;
-                triangles.push_back(make_shared<Triangle>(
-                    vertices[v1 - 1], vertices[v2 - 1], vertices[v3 - 1], mat
-                ));
+                auto count = long(vertices.size());
+                if (v1 < 1 || v1 > count || v2 < 1 || v2 > count || v3 < 1 || v3 > count)
+                    continue;
+                indices.push_back(uint32_t(v1 - 1));
+                indices.push_back(uint32_t(v2 - 1));
+                indices.push_back(uint32_t(v3 - 1));
             }
         }
 
-        return triangles;
+        return true;
     }
 };
 
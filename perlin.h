@@ -88,7 +88,7 @@ private:
 
     static void permute(int* p, int n) {
         for (int i = n - 1; i > 0; i--) {
-            int target = RandomGenerator::instance().random_int(0, i);
+            int target = random_int(0, i);
             int tmp = p[i];
             p[i] = p[target];
             p[target] = tmp;
@@ -0,0 +1,115 @@
+#ifndef PRIMITIVE_STORE_H
+#define PRIMITIVE_STORE_H
+
+#include "rt.h"
+
+#include "hittable.h"
+#include "sphere.h"
+#include "triangle.h"
+
+#include <typeinfo>
+#include <vector>
+
+class primitive_store {
+    // A BVH's leaf primitives laid out for traversal, grouped by type. For spheres and
+    // Triangles, the built-in primitives, the shape a ray test reads (sphere_shape,
+    // triangle_shape) is copied into an array of that type in leaf order, and each leaf slot
+    // records the type and the position in that array. Testing a slot is then a switch and a
+    // direct call the compiler inlines into the traversal loop, on plain structs that sit next
+    // to each other rather than behind a pointer and a vtable each. A hit still names the
+    // original object, whose finalize() fills in the record. Every other hittable (instances,
+    // meshes, user types) is called through its virtual interface.
+    //
+    // The shapes are copies; refresh() takes them again after the objects have been updated.
+public:
+    void assign(const std::vector<shared_ptr<hittable>>& objects) {
+        slots.clear();
+        spheres.clear();
+        triangles.clear();
+        slots.reserve(objects.size());
+
+        for (const auto& object : objects) {
+            // Only the exact types are copied; a subclass could override what the copy would not.
+            const hittable& original = *object;
+            if (typeid(original) == typeid(sphere)) {
+                slots.push_back({ &original, kind::sphere, uint32_t(spheres.size()) });
+                spheres.push_back(static_cast<const sphere&>(original).shape());
+            }
+            else if (typeid(original) == typeid(Triangle)) {
+                slots.push_back({ &original, kind::triangle, uint32_t(triangles.size()) });
+                triangles.push_back(static_cast<const Triangle&>(original).shape());
+            }
+            else {
+                slots.push_back({ &original, kind::other, 0 });
+            }
+        }
+    }
+
+    // Copies the shapes again from the objects given to assign().
+    void refresh() {
+        for (const auto& slot : slots) {
+            if (slot.type == kind::sphere)
+                spheres[slot.index] = static_cast<const sphere*>(slot.object)->shape();
+            else if (slot.type == kind::triangle)
+                triangles[slot.index] = static_cast<const Triangle*>(slot.object)->shape();
+        }
+    }
+
+    // hittable::intersect and hittable::occluded on leaf primitive i.
+    bool intersect(uint32_t i, const ray& r, interval ray_t, hit_record& rec) const {
+        const auto& slot = slots[i];
+        double t;
+        switch (slot.type) {
+        case kind::sphere:
+            if (!spheres[slot.index].intersect(r, ray_t, t))
+                return false;
+            break;
+        case kind::triangle:
+            if (!triangles[slot.index].intersect(r, ray_t, t))
+                return false;
+            break;
+        default:
+            return slot.object->intersect(r, ray_t, rec);
+        }
+
+        rec.t = t;
+        rec.object = slot.object;
+        return true;
+    }
+
+    bool occluded(uint32_t i, const ray& r, interval ray_t) const {
+        const auto& slot = slots[i];
+        switch (slot.type) {
+        case kind::sphere:
+            return spheres[slot.index].occluded(r, ray_t);
+        case kind::triangle:
+            return triangles[slot.index].occluded(r, ray_t);
+        default:
+            return slot.object->occluded(r, ray_t);
+        }
+    }
+
+    size_t sphere_count() const { return spheres.size(); }
+    size_t triangle_count() const { return triangles.size(); }
+    size_t other_count() const { return slots.size() - spheres.size() - triangles.size(); }
+
+    size_t memory_bytes() const {
+        return slots.capacity() * sizeof(slot) + spheres.capacity() * sizeof(sphere_shape)
+            + triangles.capacity() * sizeof(triangle_shape);
+    }
+
+private:
+    enum class kind : uint32_t { sphere, triangle, other };
+
+    struct slot {
+        const hittable* object;  // Owned by the BVH
+        kind type;
+        uint32_t index;          // Into the array of that type
+    };
+
+    std::vector<slot> slots;  // One per leaf primitive, in leaf order
+    std::vector<sphere_shape> spheres;
+    std::vector<triangle_shape> triangles;
+};
+
+#endif
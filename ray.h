@@ -28,4 +28,24 @@ private:
     double tm;
 };
 
+class traversal_ray {
+    // A ray prepared for many box tests: the reciprocal of the direction and its sign per axis
+    // are computed once per ray instead of once per box. The sign picks each box's near and far
+    // plane directly, so the slab test needs no swap. It is taken from the sign bit rather than
+    // a comparison, so a -0.0 component (reciprocal -inf) is treated as negative too.
+public:
+    point3 origin;
+    vec3 inv_direction;
+    int negative[3];  // 1 where the direction points down the axis: index of the near plane
+
+    explicit traversal_ray(const ray& r)
+        : origin(r.origin()),
+          inv_direction(1.0 / r.direction().x(), 1.0 / r.direction().y(), 1.0 / r.direction().z()),
+          negative{ std::signbit(r.direction().x()), std::signbit(r.direction().y()),
+                    std::signbit(r.direction().z()) } {}
+
+    // Direction octant, one bit per axis (x lowest).
+    int octant() const { return negative[0] | negative[1] << 1 | negative[2] << 2; }
+};
+
 #endif
\ No newline at end of file
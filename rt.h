@@ -1,11 +1,13 @@
 #ifndef RT_H
 #define RT_H
 
+#include <atomic>
 #include <cmath>
+#include <cstdint>
+#include <functional>
 #include <iostream>
 #include <limits>
 #include <memory>
-#include <random>
 // C++ Std Usings
 
 using std::make_shared;
@@ -23,38 +25,206 @@ inline double degrees_to_radians(double degrees) {
     return degrees * degrees_to_radians_factor;
 }
 
-class RandomGenerator {
+// Random Numbers
+
+constexpr uint64_t golden_gamma = 0x9e3779b97f4a7c15ull;
+
+inline uint64_t mix64(uint64_t z) {
+    // splitmix64 finalizer: a bijective avalanche of all 64 bits.
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+inline uint64_t hash_combine(uint64_t seed, uint64_t value) {
+    // Folds a value into a running hash, for keying objects by their parameters.
+    return mix64(seed ^ (value + golden_gamma));
+}
+
+inline uint64_t hash_combine(uint64_t seed, double value) {
+    return hash_combine(seed, uint64_t(std::hash<double>()(value)));
+}
+
+inline double bits_to_double(uint64_t bits) {
+    // The top 53 bits scaled by 2^-53 give every representable double in [0,1) with a uniform
+    // spacing, without going through a distribution object.
+    return double(bits >> 11) * 0x1.0p-53;
+}
+
+class xoshiro256 {
+    // xoshiro256++ generator (Blackman & Vigna): 32 bytes of state, a handful of shifts, rotates
+    // and adds per draw, and good enough statistical quality for Monte Carlo sampling.
 public:
+    explicit xoshiro256(uint64_t seed) {
+        // Expand the seed with splitmix64 so that nearby seeds give unrelated states.
+        for (auto& word : state) {
+            seed += golden_gamma;
+            word = mix64(seed);
+        }
+    }
+
+    uint64_t next() {
+        const uint64_t result = rotl(state[0] + state[3], 23) + state[0];
+        const uint64_t t = state[1] << 17;
 
-    RandomGenerator(const RandomGenerator&) = delete;
-    RandomGenerator& operator=(const RandomGenerator&) = delete;
+        state[2] ^= state[0];
+        state[3] ^= state[1];
+        state[1] ^= state[2];
+        state[0] ^= state[3];
+        state[2] ^= t;
+        state[3] = rotl(state[3], 45);
 
-    static RandomGenerator& instance() {
-        static RandomGenerator instance;
-        return instance;
+        return result;
     }
 
-    double random_double() {
-        return dist(rng);
+    double next_double() {
+        return bits_to_double(next());
     }
 
-    double random_double(double min, double max) {
-        std::uniform_real_distribution<double> dist(min, max);
-        return dist(rng);
+private:
+    uint64_t state[4];
+
+    static uint64_t rotl(uint64_t x, int k) {
+        return (x << k) | (x >> (64 - k));
     }
+};
 
-    int random_int(int min, int max) {
-        // Returns a random integer in [min,max].
-        return int(random_double(min, max + 1));
+class sample_stream {
+    // Counter-based random stream: every value is a pure function of (scene seed, pixel index,
+    // sample index, bounce, dimension), so the result of a pixel sample does not depend on which
+    // thread or machine evaluates it, or in which order.
+public:
+    sample_stream() = default;
+
+    sample_stream(uint64_t seed, uint64_t pixel, uint64_t sample)
+        : sample_key(mix64(mix64(mix64(seed) ^ pixel) ^ sample)) {
+        start_bounce(0);
+    }
+
+    void start_bounce(uint32_t bounce) {
+        // Each bounce gets its own sub-stream, so a rejection loop that draws more numbers on
+        // one bounce never shifts the dimensions used by the next one.
+        bounce_key = mix64(sample_key + golden_gamma * (uint64_t(bounce) + 1));
+        dimension = 0;
+    }
+
+    uint64_t next() {
+        return mix64(bounce_key + golden_gamma * ++dimension);
+    }
+
+    double next_double() {
+        return bits_to_double(next());
     }
 
 private:
+    uint64_t sample_key = 0;
+    uint64_t bounce_key = 0;
+    uint64_t dimension = 0;
+};
 
-    RandomGenerator() : rng(std::random_device{}()), dist(0.0, 1.0) {}
+class sample_source {
+    // Hook for structured sample patterns (see sampler.h). While one is installed on a thread,
+    // every random draw on that thread is taken from it instead of the keyed stream.
+public:
+    virtual ~sample_source() = default;
 
-    std::mt19937 rng;
-    std::uniform_real_distribution<double> dist;
+    virtual void start_bounce(uint32_t bounce) = 0;
+    virtual double next_1d() = 0;
+    virtual void next_2d(double& u, double& v) = 0;
 };
+
+class thread_random {
+    // Per-thread random source. Inside a pixel sample the installed sample pattern or the keyed
+    // stream is used; everywhere else (scene setup, textures) draws come from a xoshiro256++
+    // engine seeded from the scene seed.
+public:
+    static thread_random& local() {
+        static thread_local thread_random source;
+        return source;
+    }
+
+    static uint64_t& scene_seed() {
+        static uint64_t seed = 0;
+        return seed;
+    }
+
+    void seed(uint64_t seed) { engine = xoshiro256(seed); }
+
+    void begin_sample(uint64_t seed, uint64_t pixel, uint64_t sample) {
+        stream = sample_stream(seed, pixel, sample);
+        keyed = true;
+    }
+
+    void start_bounce(uint32_t bounce) {
+        if (pattern)
+            pattern->start_bounce(bounce);
+        else
+            stream.start_bounce(bounce);
+    }
+
+    // Routes draws to the given pattern until end_sample(). The caller starts its pixel sample.
+    void use_pattern(sample_source* source) { pattern = source; }
+
+    void end_sample() {
+        keyed = false;
+        pattern = nullptr;
+    }
+
+    double next_double() {
+        if (pattern)
+            return pattern->next_1d();
+        return keyed ? stream.next_double() : engine.next_double();
+    }
+
+    void next_double2(double& u, double& v) {
+        if (pattern)
+            return pattern->next_2d(u, v);
+        u = next_double();
+        v = next_double();
+    }
+
+private:
+    xoshiro256 engine;
+    sample_stream stream;
+    sample_source* pattern = nullptr;
+    bool keyed = false;
+
+    thread_random() : engine(mix64(scene_seed()) ^ thread_ordinal()) {}
+
+    static uint64_t thread_ordinal() {
+        // The first thread to draw (normally the one building the scene) gets ordinal zero, so
+        // scene setup is reproducible for a given seed.
+        static std::atomic<uint64_t> next_ordinal{ 0 };
+        return next_ordinal++;
+    }
+};
+
+inline void seed_random(uint64_t seed) {
+    // Reseeds the calling thread's engine and the seed that new threads start from.
+    thread_random::scene_seed() = seed;
+    thread_random::local().seed(mix64(seed));
+}
+
+inline double random_double() {
+    // Returns a random real in [0,1).
+    return thread_random::local().next_double();
+}
+
+inline void random_double2(double& u, double& v) {
+    // Returns a random point in [0,1)^2. Sample patterns stratify the pair jointly.
+    thread_random::local().next_double2(u, v);
+}
+
+inline double random_double(double min, double max) {
+    // Returns a random real in [min,max).
+    return min + (max - min) * random_double();
+}
+
+inline int random_int(int min, int max) {
+    // Returns a random integer in [min,max].
+    return int(random_double(min, max + 1));
+}
+
 // Common Headers
 
 #include "color.h"
@@ -0,0 +1,440 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include "rt.h"
+
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Sample patterns that replace independent uniform numbers with better distributed ones. The
+// camera installs one per pixel sample; the time, pixel offset and lens position take the first
+// dimensions and every bounce after that gets its own block, so a given draw always lands on
+// the same dimension of the pattern. Draws past a block's end (or past what a pattern supports)
+// fall back to the keyed random stream, which keeps results independent of thread scheduling.
+
+enum class sampler_type {
+    independent,  // Keyed uniform random numbers, no structure
+    stratified,   // Jittered strata, shuffled per pixel and dimension
+    halton,       // Halton sequence with a per-pixel Cranley-Patterson rotation
+    sobol,        // Owen-scrambled, index-shuffled Sobol (0,2)-sequence
+    blue_noise,   // Rank-1 lattice sequence rotated by a blue-noise mask
+};
+
+class sampler : public sample_source {
+public:
+    static constexpr uint32_t camera_dimensions = 5;  // time, pixel (2D), lens (2D)
+    static constexpr uint32_t bounce_dimensions = 4;  // scatter direction (2D), choice, roulette
+
+    explicit sampler(int samples_per_pixel) : samples_per_pixel(samples_per_pixel) {}
+
+    void start_pixel_sample(uint64_t seed, int x, int y, uint64_t pixel, int sample) {
+        pixel_x = x;
+        pixel_y = y;
+        pixel_key = mix64(mix64(seed) ^ pixel);
+        sample_index = uint32_t(sample);
+        fallback = sample_stream(seed, pixel, sample);
+        dimension = 0;
+        dimension_end = camera_dimensions;
+    }
+
+    void start_bounce(uint32_t bounce) override {
+        fallback.start_bounce(bounce);
+        dimension = bounce == 0 ? 0 : camera_dimensions + (bounce - 1) * bounce_dimensions;
+        dimension_end = bounce == 0 ? camera_dimensions : dimension + bounce_dimensions;
+    }
+
+    double next_1d() override {
+        if (dimension >= dimension_end || dimension >= max_dimensions())
+            return fallback.next_double();
+        return sample_1d(dimension++);
+    }
+
+    void next_2d(double& u, double& v) override {
+        if (dimension + 2 > dimension_end || dimension + 2 > max_dimensions()) {
+            u = fallback.next_double();
+            v = fallback.next_double();
+            return;
+        }
+        sample_2d(dimension, u, v);
+        dimension += 2;
+    }
+
+protected:
+    int samples_per_pixel;
+    int pixel_x = 0, pixel_y = 0;
+    uint64_t pixel_key = 0;
+    uint32_t sample_index = 0;
+
+    virtual uint32_t max_dimensions() const { return UINT32_MAX; }
+    virtual double sample_1d(uint32_t dim) = 0;
+    virtual void sample_2d(uint32_t dim, double& u, double& v) = 0;
+
+    uint64_t dimension_hash(uint32_t dim) const {
+        return mix64(pixel_key + golden_gamma * (uint64_t(dim) + 1));
+    }
+
+    double dimension_random(uint32_t dim) const {
+        // A uniform number fixed per (pixel, dimension), shared by all samples of the pixel.
+        return bits_to_double(mix64(dimension_hash(dim)));
+    }
+
+    static uint32_t permute_index(uint32_t i, uint32_t l, uint32_t p) {
+        // Kensler's hash-based permutation of [0, l) ("Correlated Multi-Jittered Sampling").
+        uint32_t w = l - 1;
+        w |= w >> 1;
+        w |= w >> 2;
+        w |= w >> 4;
+        w |= w >> 8;
+        w |= w >> 16;
+        do {
+            i ^= p;
+            i *= 0xe170893d;
+            i ^= p >> 16;
+            i ^= (i & w) >> 4;
+            i ^= p >> 8;
+            i *= 0x0929eb3f;
+            i ^= p >> 23;
+            i ^= (i & w) >> 1;
+            i *= 1 | p >> 27;
+            i *= 0x6935fa69;
+            i ^= (i & w) >> 11;
+            i *= 0x74dcb303;
+            i ^= (i & w) >> 2;
+            i *= 0x9e501cc3;
+            i ^= (i & w) >> 2;
+            i *= 0xc860a3df;
+            i &= w;
+            i ^= i >> 5;
+        } while (i >= l);
+        return (i + p) % l;
+    }
+
+    static double wrap(double x) {
+        x -= std::floor(x);
+        return x < 1.0 ? x : 0.0;
+    }
+
+private:
+    sample_stream fallback;
+    uint32_t dimension = 0;
+    uint32_t dimension_end = 0;
+};
+
+class independent_sampler : public sampler {
+public:
+    using sampler::sampler;
+
+protected:
+    uint32_t max_dimensions() const override { return 0; }
+    double sample_1d(uint32_t) override { return 0; }
+    void sample_2d(uint32_t, double& u, double& v) override { u = v = 0; }
+};
+
+class stratified_sampler : public sampler {
+    // Splits each 1D dimension into samples_per_pixel strata and each 2D dimension into a
+    // near-square grid of the same size. The order strata are visited in is permuted per pixel
+    // and dimension, so dimensions stay uncorrelated. Samples beyond the stratum count (from
+    // progressive or adaptive passes) are plain jittered uniform numbers.
+public:
+    using sampler::sampler;
+
+protected:
+    double sample_1d(uint32_t dim) override {
+        auto n = uint32_t(samples_per_pixel);
+        auto jitter = bits_to_double(mix64(dimension_hash(dim) ^ (uint64_t(sample_index) << 32)));
+        if (sample_index >= n)
+            return jitter;
+        auto stratum = permute_index(sample_index, n, uint32_t(dimension_hash(dim)));
+        return (stratum + jitter) / n;
+    }
+
+    void sample_2d(uint32_t dim, double& u, double& v) override {
+        auto nx = std::max(1u, uint32_t(std::sqrt(double(samples_per_pixel))));
+        auto ny = std::max(1u, uint32_t(samples_per_pixel) / nx);
+        auto key = mix64(dimension_hash(dim) ^ (uint64_t(sample_index) << 32));
+        auto jx = bits_to_double(key);
+        auto jy = bits_to_double(mix64(key));
+        if (sample_index >= nx * ny) {
+            u = jx;
+            v = jy;
+            return;
+        }
+        auto stratum = permute_index(sample_index, nx * ny, uint32_t(dimension_hash(dim)));
+        u = (stratum % nx + jx) / nx;
+        v = (stratum / nx + jy) / ny;
+    }
+};
+
+class halton_sampler : public sampler {
+    // Dimension d uses the radical inverse in the d-th prime base. A toroidal shift fixed per
+    // pixel and dimension decorrelates neighbouring pixels without breaking the stratification.
+public:
+    using sampler::sampler;
+
+protected:
+    uint32_t max_dimensions() const override { return uint32_t(std::size(primes)); }
+
+    double sample_1d(uint32_t dim) override {
+        return wrap(radical_inverse(primes[dim], sample_index) + dimension_random(dim));
+    }
+
+    void sample_2d(uint32_t dim, double& u, double& v) override {
+        u = sample_1d(dim);
+        v = sample_1d(dim + 1);
+    }
+
+private:
+    static constexpr uint32_t primes[] = {
+        2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53,
+        59, 61, 67, 71, 73, 79, 83, 89, 97, 101, 103, 107, 109, 113, 127, 131,
+    };
+
+    static double radical_inverse(uint32_t base, uint32_t index) {
+        double inv_base = 1.0 / base;
+        double inv_base_n = 1.0;
+        uint64_t reversed = 0;
+        while (index) {
+            auto next = index / base;
+            reversed = reversed * base + (index - next * base);
+            inv_base_n *= inv_base;
+            index = next;
+        }
+        return std::fmin(reversed * inv_base_n, 1.0 - 0x1.0p-53);
+    }
+};
+
+class sobol_sampler : public sampler {
+    // Burley's "Practical Hash-based Owen Scrambling": each 2D dimension pair uses the first
+    // two Sobol dimensions, a (0,2)-sequence, with the sample index shuffled and both
+    // coordinates nested-uniform (Owen) scrambled by hashes of the pixel and dimension. 1D
+    // dimensions use the scrambled van der Corput sequence the same way.
+public:
+    using sampler::sampler;
+
+protected:
+    double sample_1d(uint32_t dim) override {
+        auto seed = uint32_t(dimension_hash(dim));
+        auto index = nested_uniform_scramble(sample_index, seed);
+        return to_unit(nested_uniform_scramble(reverse_bits(index), seed ^ 0x5bd1e995u));
+    }
+
+    void sample_2d(uint32_t dim, double& u, double& v) override {
+        auto seed = uint32_t(dimension_hash(dim));
+        auto index = nested_uniform_scramble(sample_index, seed);
+        u = to_unit(nested_uniform_scramble(reverse_bits(index), uint32_t(mix64(seed + 1))));
+        v = to_unit(nested_uniform_scramble(sobol_dimension_1(index), uint32_t(mix64(seed + 2))));
+    }
+
+private:
+    static uint32_t reverse_bits(uint32_t x) {
+        x = (x << 16) | (x >> 16);
+        x = ((x & 0x00ff00ffu) << 8) | ((x & 0xff00ff00u) >> 8);
+        x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+        x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+        x = ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+        return x;
+    }
+
+    static uint32_t sobol_dimension_1(uint32_t index) {
+        // Second Sobol dimension (primitive polynomial x + 1): direction numbers follow
+        // m_k = m_{k-1} xor 2 m_{k-1}, i.e. bit k of the index contributes the k-th row of
+        // Pascal's triangle mod 2, stored from the most significant bit down.
+        uint32_t result = 0;
+        uint32_t direction = 1u << 31;
+        for (; index; index >>= 1, direction ^= direction >> 1) {
+            if (index & 1)
+                result ^= direction;
+        }
+        return result;
+    }
+
+    static uint32_t laine_karras_permutation(uint32_t x, uint32_t seed) {
+        x += seed;
+        x ^= x * 0x6c50b47cu;
+        x ^= x * 0xb82f1e52u;
+        x ^= x * 0xc7afe638u;
+        x ^= x * 0x8d22f6e6u;
+        return x;
+    }
+
+    static uint32_t nested_uniform_scramble(uint32_t x, uint32_t seed) {
+        return reverse_bits(laine_karras_permutation(reverse_bits(x), seed));
+    }
+
+    static double to_unit(uint32_t x) {
+        return x * 0x1.0p-32;
+    }
+};
+
+class blue_noise_sampler : public sampler {
+    // Rank-1 lattice sequences (golden ratio in 1D, the R2 sequence in 2D) given a toroidal
+    // shift read from a tiled blue-noise mask. Shifts of neighbouring pixels are as different as
+    // possible, so the remaining error shows up as high-frequency noise that the eye and
+    // denoisers average away. Each dimension reads the mask at its own offset.
+public:
+    using sampler::sampler;
+
+protected:
+    double sample_1d(uint32_t dim) override {
+        constexpr double alpha = 0.6180339887498948482;
+        return wrap(mask_value(dim, 0) + alpha * lattice_index(dim));
+    }
+
+    void sample_2d(uint32_t dim, double& u, double& v) override {
+        // R2 sequence: powers of the inverse plastic number.
+        constexpr double a1 = 0.7548776662466927600;
+        constexpr double a2 = 0.5698402909980532659;
+        auto index = lattice_index(dim);
+        u = wrap(mask_value(dim, 0) + a1 * index);
+        v = wrap(mask_value(dim, 1) + a2 * index);
+    }
+
+private:
+    static constexpr int mask_size = 64;
+
+    uint32_t lattice_index(uint32_t dim) const {
+        // Every dimension walks the same lattice, so the first samples_per_pixel indices are
+        // shuffled per dimension; otherwise all dimensions would move in lockstep.
+        auto n = uint32_t(samples_per_pixel);
+        if (sample_index >= n)
+            return sample_index;
+        return permute_index(sample_index, n, uint32_t(mix64(golden_gamma * (uint64_t(dim) + 1))));
+    }
+
+    double mask_value(uint32_t dim, uint32_t channel) const {
+        // The mask offset depends only on the dimension, so spatial blue-noise structure is
+        // preserved from pixel to pixel within every dimension.
+        auto offset = mix64(golden_gamma * (uint64_t(dim) * 2 + channel + 1));
+        auto x = (pixel_x + int(offset & 63)) & (mask_size - 1);
+        auto y = (pixel_y + int((offset >> 8) & 63)) & (mask_size - 1);
+        return mask()[y * mask_size + x];
+    }
+
+    static const std::vector<double>& mask() {
+        static const std::vector<double> values = void_and_cluster();
+        return values;
+    }
+
+    static std::vector<double> void_and_cluster() {
+        // Ulichney's void-and-cluster method on a toroidal 64x64 grid with a Gaussian energy
+        // filter (sigma 1.5). Pixels get ranks in the order they join the pattern; the rank
+        // divided by the pixel count is the mask value. Generated once, from a fixed seed.
+        constexpr int n = mask_size * mask_size;
+        constexpr double sigma = 1.5;
+
+        std::vector<double> kernel(n);
+        for (int dy = 0; dy < mask_size; dy++) {
+            for (int dx = 0; dx < mask_size; dx++) {
+                auto wx = std::min(dx, mask_size - dx);
+                auto wy = std::min(dy, mask_size - dy);
+                kernel[dy * mask_size + dx] = std::exp(-(wx * wx + wy * wy) / (2 * sigma * sigma));
+            }
+        }
+
+        std::vector<uint8_t> pattern(n, 0);
+        std::vector<double> energy(n, 0.0);
+        auto splat = [&](int p, double sign) {
+            int px = p % mask_size, py = p / mask_size;
+            for (int y = 0; y < mask_size; y++) {
+                auto ky = ((y - py) & (mask_size - 1)) * mask_size;
+                for (int x = 0; x < mask_size; x++)
+                    energy[y * mask_size + x] += sign * kernel[ky + ((x - px) & (mask_size - 1))];
+            }
+        };
+        auto tightest_cluster = [&] {
+            int best = -1;
+            for (int p = 0; p < n; p++)
+                if (pattern[p] && (best < 0 || energy[p] > energy[best]))
+                    best = p;
+            return best;
+        };
+        auto largest_void = [&] {
+            int best = -1;
+            for (int p = 0; p < n; p++)
+                if (!pattern[p] && (best < 0 || energy[p] < energy[best]))
+                    best = p;
+            return best;
+        };
+
+        // Initial binary pattern: a tenth of the pixels at random, relaxed until moving the
+        // tightest cluster into the largest void no longer changes anything.
+        xoshiro256 rng(0x5eed);
+        int initial_ones = 0;
+        while (initial_ones < n / 10) {
+            auto p = int(rng.next() % n);
+            if (!pattern[p]) {
+                pattern[p] = 1;
+                splat(p, +1);
+                initial_ones++;
+            }
+        }
+        while (true) {
+            auto cluster = tightest_cluster();
+            pattern[cluster] = 0;
+            splat(cluster, -1);
+            auto hole = largest_void();
+            pattern[hole] = 1;
+            splat(hole, +1);
+            if (hole == cluster)
+                break;
+        }
+
+        std::vector<double> rank(n);
+        auto initial_pattern = pattern;
+        auto initial_energy = energy;
+
+        // Phase 1: rank the initial ones by removing tightest clusters.
+        for (int ones = initial_ones; ones > 0; ones--) {
+            auto cluster = tightest_cluster();
+            pattern[cluster] = 0;
+            splat(cluster, -1);
+            rank[cluster] = ones - 1;
+        }
+
+        // Phases 2 and 3: fill the remaining pixels, always into the largest void. Past half
+        // full, the zero pixel with the most energy from other zeros is the same pixel.
+        pattern = initial_pattern;
+        energy = initial_energy;
+        for (int ones = initial_ones; ones < n; ones++) {
+            auto hole = largest_void();
+            pattern[hole] = 1;
+            splat(hole, +1);
+            rank[hole] = ones;
+        }
+
+        for (auto& value : rank)
+            value = (value + 0.5) / n;
+        return rank;
+    }
+};
+
+inline bool parse_sampler_type(const std::string& name, sampler_type& type) {
+    const std::pair<const char*, sampler_type> names[] = {
+        { "independent", sampler_type::independent },
+        { "stratified", sampler_type::stratified },
+        { "halton", sampler_type::halton },
+        { "sobol", sampler_type::sobol },
+        { "blue_noise", sampler_type::blue_noise },
+    };
+    for (const auto& [candidate, value] : names) {
+        if (name == candidate) {
+            type = value;
+            return true;
+        }
+    }
+    return false;
+}
+
+inline std::unique_ptr<sampler> make_sampler(sampler_type type, int samples_per_pixel) {
+    switch (type) {
+        case sampler_type::stratified: return std::make_unique<stratified_sampler>(samples_per_pixel);
+        case sampler_type::halton: return std::make_unique<halton_sampler>(samples_per_pixel);
+        case sampler_type::sobol: return std::make_unique<sobol_sampler>(samples_per_pixel);
+        case sampler_type::blue_noise: return std::make_unique<blue_noise_sampler>(samples_per_pixel);
+        default: return std::make_unique<independent_sampler>(samples_per_pixel);
+    }
+}
+
+#endif
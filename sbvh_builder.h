@@ -0,0 +1,369 @@
+#ifndef SBVH_BUILDER_H
+#define SBVH_BUILDER_H
+
+#include "rt.h"
+
+#include "aabb.h"
+#include "bvh_builder.h"
+#include "hittable.h"
+
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <vector>
+
+class sbvh_builder {
+    // Spatial-split BVH (Stich, Friedrich and Dietrich, "Spatial Splits in Bounding Volume
+    // Hierarchies", 2009). Every node weighs the binned object split of bvh_builder against a
+    // spatial split: a plane that cuts the node's box itself, with each primitive straddling it
+    // clipped into a reference on either side. Long or thin triangles then stop stretching
+    // both children over the same space, at the price of some primitives being listed in more
+    // than one leaf. Spatial splits are only tried where the best object split leaves the
+    // children overlapping, and only within the budget of extra references: split_budget times
+    // the primitive count at the root, which every split shares out between its children in
+    // proportion to their references, so no one subtree can use up the budget of the rest.
+    //
+    // The build is serial and several times slower than bvh_builder, so it is meant for static
+    // meshes that are built once and traced many times.
+public:
+    // Cuts the part of primitive `index` inside box at a plane on axis, as hittable::split_box.
+    using split_function = std::function<void(uint32_t index, const aabb& box, int axis, double position,
+        aabb& left, aabb& right)>;
+
+    static constexpr double min_overlap = 1e-5;  // Overlap, relative to the root area, that makes
+                                                 // a node try spatial splits
+
+    sbvh_builder(std::vector<bvh_prim_ref>& refs, const split_function& split_box, const bvh_build_options& options)
+        : refs(refs), split_box(split_box), options(options) {}
+
+    // Same contract as bvh_builder::build, except that refs may grow: a primitive split across
+    // leaves appears once per leaf, each reference carrying its clipped box.
+    std::vector<flat_bvh_node> build() {
+        std::vector<flat_bvh_node> nodes;
+        if (refs.empty())
+            return nodes;
+
+        bin_count = std::clamp(options.bin_count, 2, bvh_builder::max_bins);
+        leaf_limit = size_t(std::clamp(options.max_leaf_size, 1, 0xffff));
+        auto budget = size_t(std::max(options.split_budget, 0.0) * refs.size());
+
+        bvh_bin root;
+        root.count = 0;
+        for (const auto& ref : refs)
+            root.add(ref.box);
+        root_area = root.area();
+
+        // The references are handed down the tree in per-node lists; refs collects the leaves.
+        std::vector<bvh_prim_ref> span;
+        span.swap(refs);
+        refs.reserve(span.size() + budget);
+        build_node(nodes, span, budget, 1);
+        return nodes;
+    }
+
+private:
+    struct split {
+        double cost = infinity;  // Surface area cost, in units of area(node)
+        int axis = -1;
+        int plane = 0;           // Splits before this bin
+        bool spatial = false;
+        aabb left, right;        // Children's bounds, for the overlap test and unsplitting
+        size_t left_count = 0, right_count = 0;
+    };
+
+    std::vector<bvh_prim_ref>& refs;
+    const split_function& split_box;
+    bvh_build_options options;
+    int bin_count = 16;
+    size_t leaf_limit = 4;
+    double root_area = 0;
+
+    uint32_t build_node(std::vector<flat_bvh_node>& nodes, std::vector<bvh_prim_ref>& span, size_t budget,
+        int depth) {
+        // Appends the subtree over span in depth-first order and returns its index. span is
+        // consumed; the subtree may add at most budget references by splitting.
+        bvh_bin box_bin, centroid_bin;
+        box_bin.count = centroid_bin.count = 0;
+        for (const auto& ref : span) {
+            box_bin.add(ref.box);
+            centroid_bin.add(ref.centroid);
+        }
+        auto bounds = box_bin.box();
+        auto centroid_bounds = centroid_bin.box();
+
+        auto index = uint32_t(nodes.size());
+        nodes.emplace_back();
+        for (int axis = 0; axis < 3; axis++) {
+            nodes[index].bounds_min[axis] = bvh_builder::round_down(bounds.axis_interval(axis).min);
+            nodes[index].bounds_max[axis] = bvh_builder::round_up(bounds.axis_interval(axis).max);
+        }
+
+        std::vector<bvh_prim_ref> left, right;
+        int axis = bounds.longest_axis();
+        if (span.size() > 1 && depth < bvh_builder::max_sah_depth) {
+            auto best = object_split(span, centroid_bounds);
+            if (best.axis >= 0 && budget > 0) {
+                auto overlap = aabb::intersection(best.left, best.right);
+                if (!overlap.is_empty() && overlap.surface_area() > min_overlap * root_area) {
+                    auto spatial = spatial_split(span, bounds, budget);
+                    if (spatial.cost < best.cost)
+                        best = spatial;
+                }
+            }
+
+            // Compare against making the span a leaf, with both costs in units of area(node).
+            auto node_area = bounds.surface_area();
+            auto split_cost = options.traversal_cost + (node_area > 0 ? best.cost / node_area : 0.0);
+            bool leaf = best.axis < 0
+                || (span.size() <= leaf_limit && double(span.size()) <= split_cost);
+            if (!leaf) {
+                axis = best.axis;
+                if (best.spatial)
+                    spatial_partition(span, bounds, best, left, right);
+                else
+                    object_partition(span, centroid_bounds, best, left, right);
+            }
+        }
+        else if (span.size() > leaf_limit) {
+            median_partition(span, axis, left, right);
+        }
+
+        if (left.empty() || right.empty()) {
+            if (span.size() <= leaf_limit) {
+                nodes[index].offset = uint32_t(refs.size());
+                nodes[index].primitive_count = uint16_t(span.size());
+                refs.insert(refs.end(), span.begin(), span.end());
+                return index;
+            }
+            // No useful plane but too many references for one leaf: split at the median.
+            left.clear();
+            right.clear();
+            axis = bounds.longest_axis();
+            median_partition(span, axis, left, right);
+        }
+
+        // What this split did not use of the budget is shared out by reference count.
+        auto children = left.size() + right.size();
+        auto remaining = budget - std::min(budget, children - span.size());
+        auto left_budget = size_t(double(remaining) * left.size() / children);
+        std::vector<bvh_prim_ref>().swap(span);
+        build_node(nodes, left, left_budget, depth + 1);
+        auto second = build_node(nodes, right, remaining - left_budget, depth + 1);
+        nodes[index].offset = second;
+        nodes[index].primitive_count = 0;
+        nodes[index].axis = uint16_t(axis);
+        return index;
+    }
+
+    split object_split(const std::vector<bvh_prim_ref>& span, const aabb& centroid_bounds) const {
+        // The binned SAH split of bvh_builder::sah_partition, also keeping the children's boxes.
+        split best;
+        std::array<bvh_bin, bvh_builder::max_bins> bins, right_bins;
+        for (int axis = 0; axis < 3; axis++) {
+            const auto& extent = centroid_bounds.axis_interval(axis);
+            if (extent.size() <= 0)
+                continue;
+            auto scale = bin_count / extent.size();
+
+            for (int b = 0; b < bin_count; b++)
+                bins[b].count = 0;
+            for (const auto& ref : span)
+                bins[bin_index(ref.centroid[axis], extent.min, scale)].add(ref.box);
+
+            bvh_bin right;
+            right.count = 0;
+            for (int plane = bin_count - 1; plane > 0; plane--) {
+                if (bins[plane].count)
+                    right.add(bins[plane]);
+                right_bins[plane] = right;
+            }
+
+            bvh_bin left;
+            left.count = 0;
+            for (int plane = 1; plane < bin_count; plane++) {
+                if (bins[plane - 1].count)
+                    left.add(bins[plane - 1]);
+                const auto& right_side = right_bins[plane];
+                if (left.count == 0 || right_side.count == 0)
+                    continue;
+                auto cost = left.area() * left.count + right_side.area() * right_side.count;
+                if (cost < best.cost) {
+                    best.cost = cost;
+                    best.axis = axis;
+                    best.plane = plane;
+                    best.left = left.box();
+                    best.right = right_side.box();
+                    best.left_count = left.count;
+                    best.right_count = right_side.count;
+                }
+            }
+        }
+        return best;
+    }
+
+    split spatial_split(const std::vector<bvh_prim_ref>& span, const aabb& bounds, size_t budget) const {
+        // Cuts the node box into bin_count equal slabs per axis. A reference enters at its first
+        // slab and exits at its last, and adds its clipped box to every slab in between; a plane
+        // then has the entries to its left and the exits to its right. Planes that would add
+        // more than budget references are skipped.
+        split best;
+        std::array<bvh_bin, bvh_builder::max_bins> bins, right_bins;
+        std::array<size_t, bvh_builder::max_bins> entries, exits;
+
+        for (int axis = 0; axis < 3; axis++) {
+            const auto& extent = bounds.axis_interval(axis);
+            if (extent.size() <= 0)
+                continue;
+
+            for (int b = 0; b < bin_count; b++) {
+                bins[b].count = 0;
+                entries[b] = exits[b] = 0;
+            }
+            for (const auto& ref : span) {
+                auto first = slab_index(ref.box.axis_interval(axis).min, extent);
+                auto last = slab_index(ref.box.axis_interval(axis).max, extent);
+                entries[first]++;
+                exits[last]++;
+                // Cut the reference at each slab boundary it crosses, left to right.
+                auto rest = ref.box;
+                for (int b = first; b < last; b++) {
+                    aabb piece, remainder;
+                    split_box(ref.index, rest, axis, plane_position(b + 1, extent), piece, remainder);
+                    if (!piece.is_empty())
+                        bins[b].add(piece);
+                    rest = remainder;
+                }
+                if (!rest.is_empty())
+                    bins[last].add(rest);
+            }
+
+            bvh_bin right;
+            right.count = 0;
+            size_t right_count = 0;
+            std::array<size_t, bvh_builder::max_bins> right_counts;
+            for (int plane = bin_count - 1; plane > 0; plane--) {
+                if (bins[plane].count)
+                    right.add(bins[plane]);
+                right_bins[plane] = right;
+                right_count += exits[plane];
+                right_counts[plane] = right_count;
+            }
+
+            bvh_bin left;
+            left.count = 0;
+            size_t left_count = 0;
+            for (int plane = 1; plane < bin_count; plane++) {
+                if (bins[plane - 1].count)
+                    left.add(bins[plane - 1]);
+                left_count += entries[plane - 1];
+                auto right_side_count = right_counts[plane];
+                if (left_count == 0 || right_side_count == 0 || left.count == 0 || right_bins[plane].count == 0)
+                    continue;
+                if (left_count + right_side_count - span.size() > budget)
+                    continue;
+                auto cost = left.area() * left_count + right_bins[plane].area() * right_side_count;
+                if (cost < best.cost) {
+                    best.cost = cost;
+                    best.axis = axis;
+                    best.plane = plane;
+                    best.spatial = true;
+                    best.left = left.box();
+                    best.right = right_bins[plane].box();
+                    best.left_count = left_count;
+                    best.right_count = right_side_count;
+                }
+            }
+        }
+        return best;
+    }
+
+    void object_partition(std::vector<bvh_prim_ref>& span, const aabb& centroid_bounds, const split& best,
+        std::vector<bvh_prim_ref>& left, std::vector<bvh_prim_ref>& right) const {
+        const auto& extent = centroid_bounds.axis_interval(best.axis);
+        auto scale = bin_count / extent.size();
+        left.reserve(best.left_count);
+        right.reserve(best.right_count);
+        for (const auto& ref : span)
+            (bin_index(ref.centroid[best.axis], extent.min, scale) < best.plane ? left : right).push_back(ref);
+    }
+
+    void spatial_partition(std::vector<bvh_prim_ref>& span, const aabb& bounds, const split& best,
+        std::vector<bvh_prim_ref>& left, std::vector<bvh_prim_ref>& right) {
+        // References wholly on one side go there. A straddling reference is split in two, unless
+        // moving all of it to one side costs less than the duplicate would ("reference
+        // unsplitting"): that side's box grows, the other side loses a reference.
+        const auto& extent = bounds.axis_interval(best.axis);
+        auto position = plane_position(best.plane, extent);
+        bvh_bin left_bin, right_bin;
+        left_bin.count = right_bin.count = 0;
+        left_bin.add(best.left);
+        right_bin.add(best.right);
+        auto left_count = double(best.left_count), right_count = double(best.right_count);
+
+        for (const auto& ref : span) {
+            auto first = slab_index(ref.box.axis_interval(best.axis).min, extent);
+            auto last = slab_index(ref.box.axis_interval(best.axis).max, extent);
+            if (last < best.plane) {
+                left.push_back(ref);
+                continue;
+            }
+            if (first >= best.plane) {
+                right.push_back(ref);
+                continue;
+            }
+
+            auto split_cost = left_bin.area() * left_count + right_bin.area() * right_count;
+            auto grown_left = left_bin, grown_right = right_bin;
+            grown_left.add(ref.box);
+            grown_right.add(ref.box);
+            auto left_only = grown_left.area() * left_count + right_bin.area() * (right_count - 1);
+            auto right_only = left_bin.area() * (left_count - 1) + grown_right.area() * right_count;
+
+            aabb left_piece, right_piece;
+            split_box(ref.index, ref.box, best.axis, position, left_piece, right_piece);
+            bool whole_left = right_piece.is_empty()
+                || (!left_piece.is_empty() && left_only < split_cost && left_only <= right_only);
+            bool whole_right = !whole_left && (left_piece.is_empty() || right_only < split_cost);
+            if (whole_left) {
+                left.push_back(ref);
+                left_bin = grown_left;
+                right_count--;
+                continue;
+            }
+            if (whole_right) {
+                right.push_back(ref);
+                right_bin = grown_right;
+                left_count--;
+                continue;
+            }
+
+            left.push_back({ left_piece, left_piece.centroid(), ref.index });
+            right.push_back({ right_piece, right_piece.centroid(), ref.index });
+        }
+    }
+
+    static void median_partition(std::vector<bvh_prim_ref>& span, int axis,
+        std::vector<bvh_prim_ref>& left, std::vector<bvh_prim_ref>& right) {
+        auto mid = span.begin() + span.size() / 2;
+        std::nth_element(span.begin(), mid, span.end(), [axis](const bvh_prim_ref& a, const bvh_prim_ref& b) {
+            return a.centroid[axis] < b.centroid[axis];
+        });
+        left.assign(span.begin(), mid);
+        right.assign(mid, span.end());
+    }
+
+    double plane_position(int plane, const interval& extent) const {
+        // The boundary before slab `plane`; the last boundary is exactly the box edge.
+        return plane >= bin_count ? extent.max : extent.min + extent.size() * plane / bin_count;
+    }
+
+    int slab_index(double x, const interval& extent) const {
+        return std::clamp(int((x - extent.min) * bin_count / extent.size()), 0, bin_count - 1);
+    }
+
+    int bin_index(double centroid, double min, double scale) const {
+        return std::clamp(int((centroid - min) * scale), 0, bin_count - 1);
+    }
+};
+
+#endif
@@ -0,0 +1,277 @@
+#include "rt.h"
+
+#include "camera.h"
+#include "scenes.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// End-to-end benchmark: builds and renders every built-in scene (and any OBJ meshes given on
+// the command line) at fixed settings, sweeping the worker thread count from 1 up to the
+// maximum. Results are written as JSON so runs can be compared over time; each scene's
+// top-level wall time and Mrays/s are those of the run with the most threads.
+//
+// Build: g++ -std=c++17 -O2 -pthread scene_bench.cpp -o rt_scene_bench
+// Usage: rt_scene_bench [--width N] [--spp N] [--depth N] [--threads N] [--seed N]
+//                       [--bvh auto|sah|median|lbvh|sbvh] [--bins N] [--leaf-size N] [--bvh-width 2|4|8]
+//                       [--build-threads N] [--split-budget X]
+//                       [--scene NAME]... [--obj FILE]... [--instances N] [--output FILE]
+
+struct thread_run {
+    int threads;
+    double seconds;
+    uint64_t rays;
+    double speedup;     // Against the single-threaded run
+    double efficiency;  // Speedup divided by thread count
+};
+
+struct scene_result {
+    std::string name;
+    std::string bvh_split;  // Builder actually used, once build_scene has resolved "auto"
+    int width, height;
+    size_t primitives;
+    size_t materials;          // Distinct materials, once duplicates are merged
+    double build_seconds;
+    double bvh_seconds;
+    bvh_stats bvh;
+    size_t mesh_triangles;     // Zero unless the scene is an OBJ mesh
+    size_t mesh_bytes;         // Vertex, index and BVH node memory of that mesh
+    double mesh_bvh_seconds;
+    bvh_stats mesh_bvh;
+    std::vector<thread_run> runs;
+};
+
+std::string json_string(const std::string& text) {
+    std::ostringstream out;
+    out << '"';
+    for (char c : text) {
+        if (c == '"' || c == '\\')
+            out << '\\' << c;
+        else if (static_cast<unsigned char>(c) < 0x20)
+            out << "\\u00" << "0123456789abcdef"[(c >> 4) & 0xf] << "0123456789abcdef"[c & 0xf];
+        else
+            out << c;
+    }
+    out << '"';
+    return out.str();
+}
+
+std::vector<int> thread_sweep(int max_threads) {
+    // 1, 2, 4, ... and the maximum itself.
+    std::vector<int> counts;
+    for (int threads = 1; threads < max_threads; threads *= 2)
+        counts.push_back(threads);
+    counts.push_back(max_threads);
+    return counts;
+}
+
+scene_result run_scene(const std::string& name, int width, int spp, int depth,
+    const bvh_build_options& bvh_options, int mesh_instances, const std::vector<int>& sweep) {
+    scene s;
+    s.bvh_options = bvh_options;
+    s.mesh_instances = mesh_instances;
+    scene_result result{ name, "", 0, 0, 0, 0, 0, 0, {}, 0, 0, 0, {}, {} };
+    if (!build_scene(name, s)) {
+        std::cerr << "Unknown scene: " << name << std::endl;
+        return result;
+    }
+
+    camera& cam = s.cam;
+    cam.image_width = width;
+    cam.samples_per_pixel = spp;
+    cam.max_depth = depth;
+    cam.total_frames = 1;
+
+    result.width = width;
+    result.height = cam.image_height_pixels();
+    result.primitives = s.primitives;
+    result.materials = s.materials->size();
+    result.build_seconds = s.build_seconds;
+    result.bvh_seconds = s.bvh_seconds;
+    if (s.bvh) {
+        result.bvh_split = bvh_split_name(s.bvh_options.split);
+        result.bvh = s.bvh->stats(bvh_options.traversal_cost);
+    }
+    if (s.mesh) {
+        result.mesh_triangles = s.mesh->triangle_count();
+        result.mesh_bytes = s.mesh->memory_bytes();
+        result.mesh_bvh_seconds = s.mesh->build_seconds();
+        result.mesh_bvh = s.mesh->stats(bvh_options.traversal_cost);
+    }
+
+    // Animated scenes are timed on their first frame, like a still.
+    if (s.animated)
+        s.world.update(0);
+
+    std::vector<uint8_t> pixels(size_t(result.width) * result.height * 3);
+    double single_thread_seconds = 0;
+
+    for (auto threads : sweep) {
+        cam.thread_count = threads;
+        cam.render(s.world, pixels.data());
+
+        const auto& stats = cam.last_render_stats();
+        if (threads == 1)
+            single_thread_seconds = stats.seconds;
+
+        auto speedup = single_thread_seconds > 0 ? single_thread_seconds / stats.seconds : 0.0;
+        result.runs.push_back({ threads, stats.seconds, stats.rays, speedup, speedup / threads });
+    }
+    return result;
+}
+
+void write_json(std::ostream& out, const std::vector<scene_result>& results, int spp, int depth,
+    uint64_t seed, int max_threads, const bvh_build_options& bvh_options, int mesh_instances) {
+    out << "{\n"
+        << "  \"settings\": {\"samples_per_pixel\": " << spp << ", \"max_depth\": " << depth
+        << ", \"seed\": " << seed << ", \"max_threads\": " << max_threads
+        << ", \"hardware_threads\": " << thread_pool::default_thread_count()
+        << ", \"bvh_split\": " << json_string(bvh_split_name(bvh_options.split))
+        << ", \"bvh_bins\": " << bvh_options.bin_count
+        << ", \"bvh_max_leaf_size\": " << bvh_options.max_leaf_size
+        << ", \"bvh_width\": " << bvh_options.width
+        << ", \"bvh_split_budget\": " << bvh_options.split_budget
+        << ", \"mesh_instances\": " << mesh_instances
+        << ", \"bvh_build_threads\": " << bvh_options.build_threads << "},\n"
+        << "  \"scenes\": [";
+
+    for (size_t n = 0; n < results.size(); n++) {
+        const auto& r = results[n];
+        const auto& widest = r.runs.empty() ? thread_run{ 0, 0, 0, 0, 0 } : r.runs.back();
+
+        out << (n ? ",\n" : "\n")
+            << "    {\n"
+            << "      \"name\": " << json_string(r.name) << ",\n"
+            << "      \"width\": " << r.width << ", \"height\": " << r.height << ",\n"
+            << "      \"primitives\": " << r.primitives << ", \"materials\": " << r.materials << ",\n"
+            << "      \"scene_build_seconds\": " << r.build_seconds << ",\n"
+            << "      \"bvh_build_seconds\": " << r.bvh_seconds << ",\n"
+            << "      \"bvh_build_seconds_per_million_primitives\": "
+            << (r.primitives ? r.bvh_seconds * 1e6 / r.primitives : 0.0) << ",\n"
+            << "      \"bvh\": {\"split\": " << json_string(r.bvh_split)
+            << ", \"interior_nodes\": " << r.bvh.interior_nodes
+            << ", \"leaves\": " << r.bvh.leaves << ", \"references\": " << r.bvh.primitives
+            << ", \"max_depth\": " << r.bvh.max_depth
+            << ", \"sah_cost\": " << r.bvh.sah_cost << "},\n"
+            << "      \"mesh\": {\"triangles\": " << r.mesh_triangles << ", \"bytes\": " << r.mesh_bytes
+            << ", \"bvh_build_seconds\": " << r.mesh_bvh_seconds
+            << ", \"leaves\": " << r.mesh_bvh.leaves << ", \"references\": " << r.mesh_bvh.primitives
+            << ", \"max_depth\": " << r.mesh_bvh.max_depth << ", \"sah_cost\": " << r.mesh_bvh.sah_cost << "},\n"
+            << "      \"wall_seconds\": " << widest.seconds << ",\n"
+            << "      \"mrays_per_second\": "
+            << (widest.seconds > 0 ? widest.rays / widest.seconds * 1e-6 : 0.0) << ",\n"
+            << "      \"threads\": [";
+
+        for (size_t t = 0; t < r.runs.size(); t++) {
+            const auto& run = r.runs[t];
+            out << (t ? ",\n" : "\n")
+                << "        {\"threads\": " << run.threads << ", \"seconds\": " << run.seconds
+                << ", \"rays\": " << run.rays << ", \"mrays_per_second\": "
+                << (run.seconds > 0 ? run.rays / run.seconds * 1e-6 : 0.0)
+                << ", \"speedup\": " << run.speedup << ", \"efficiency\": " << run.efficiency << "}";
+        }
+        out << "\n      ]\n    }";
+    }
+    out << "\n  ]\n}\n";
+}
+
+int main(int argc, char* argv[]) {
+    int width = 320;
+    int spp = 16;
+    int depth = 50;
+    int max_threads = thread_pool::default_thread_count();
+    int mesh_instances = 1;
+    uint64_t seed = 1;
+    std::string output;
+    std::vector<std::string> names;
+    bvh_build_options bvh_options;
+
+    for (int arg = 1; arg < argc; arg++) {
+        std::string option = argv[arg];
+        if (arg + 1 >= argc) {
+            std::cerr << "Missing value for option: " << option << std::endl;
+            return 1;
+        }
+        else if (option == "--width")
+            width = std::atoi(argv[++arg]);
+        else if (option == "--spp")
+            spp = std::atoi(argv[++arg]);
+        else if (option == "--depth")
+            depth = std::atoi(argv[++arg]);
+        else if (option == "--threads")
+            max_threads = std::atoi(argv[++arg]);
+        else if (option == "--seed")
+            seed = std::stoull(argv[++arg]);
+        else if (option == "--bvh") {
+            if (!parse_bvh_split(argv[++arg], bvh_options.split)) {
+                std::cerr << "Unknown BVH split: " << argv[arg] << " (use auto, sah, median, lbvh or sbvh)" << std::endl;
+                return 1;
+            }
+        }
+        else if (option == "--bins")
+            bvh_options.bin_count = std::atoi(argv[++arg]);
+        else if (option == "--leaf-size")
+            bvh_options.max_leaf_size = std::atoi(argv[++arg]);
+        else if (option == "--bvh-width")
+            bvh_options.width = std::atoi(argv[++arg]);
+        else if (option == "--build-threads")
+            bvh_options.build_threads = std::atoi(argv[++arg]);
+        else if (option == "--split-budget")
+            bvh_options.split_budget = std::atof(argv[++arg]);
+        else if (option == "--instances")
+            mesh_instances = std::atoi(argv[++arg]);
+        else if (option == "--scene" || option == "--obj")
+            names.push_back(argv[++arg]);
+        else if (option == "--output")
+            output = argv[++arg];
+        else {
+            std::cerr << "Unknown option: " << option << std::endl;
+            return 1;
+        }
+    }
+
+    if (width < 1 || spp < 1 || depth < 1 || max_threads < 1) {
+        std::cerr << "--width, --spp, --depth and --threads must be positive" << std::endl;
+        return 1;
+    }
+    if (bvh_options.width != 2 && bvh_options.width != 4 && bvh_options.width != 8) {
+        std::cerr << "--bvh-width must be 2, 4 or 8" << std::endl;
+        return 1;
+    }
+
+    // With no --scene, every built-in scene runs, followed by any --obj meshes.
+    bool only_meshes = std::all_of(names.begin(), names.end(), is_obj_filename);
+    if (only_meshes) {
+        std::vector<std::string> all;
+        for (const auto& entry : scene_list())
+            all.push_back(entry.name);
+        names.insert(names.begin(), all.begin(), all.end());
+    }
+
+    auto sweep = thread_sweep(max_threads);
+    std::vector<scene_result> results;
+
+    for (const auto& name : names) {
+        // Reseed before every scene so its random layout does not depend on which scenes ran
+        // before it.
+        seed_random(seed);
+        std::clog << "Benchmarking " << name << '\n';
+        results.push_back(run_scene(name, width, spp, depth, bvh_options, mesh_instances, sweep));
+    }
+
+    if (output.empty()) {
+        write_json(std::cout, results, spp, depth, seed, max_threads, bvh_options, mesh_instances);
+        return 0;
+    }
+
+    std::ofstream file(output);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open file: " << output << std::endl;
+        return 1;
+    }
+    write_json(file, results, spp, depth, seed, max_threads, bvh_options, mesh_instances);
+    return 0;
+}
@@ -0,0 +1,323 @@
+#ifndef SCENES_H
+#define SCENES_H
+
+#include "rt.h"
+
+#include "bvh.h"
+#include "camera.h"
+#include "hittable.h"
+#include "hittable_list.h"
+#include "instance.h"
+#include "material.h"
+#include "obj_loader.h"
+#include "sphere.h"
+#include "triangle_mesh.h"
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+// The built-in scenes, independent of how they are displayed. Each builder fills in the world
+// and the camera settings; the front end (SDL window or headless) may override resolution,
+// sample counts and threading before rendering.
+
+struct scene {
+    hittable_list world;
+    shared_ptr<material_table> materials = make_shared<material_table>();  // Named by ID in the world
+    camera cam;
+    bool animated = false;  // Rendered with camera::render_sequence rather than as a still
+    bool use_bvh = false;   // Wrap the world in a bvh_node once the builder has filled it
+    bvh_build_options bvh_options;  // How that BVH is built; set before calling build_scene,
+                                    // which resolves bvh_split::automatic
+    shared_ptr<bvh_node> bvh;       // Root of the world's BVH, if one was built
+    int mesh_instances = 1;         // Copies of an OBJ mesh to place, sharing one mesh BVH
+    shared_ptr<triangle_mesh> mesh; // The OBJ mesh, if the scene has one
+
+    size_t primitives = 0;        // Objects the builder added to the world
+    double build_seconds = 0;     // Time spent in the scene builder
+    double bvh_seconds = 0;       // Time spent building the BVH
+};
+
+inline void bouncing_spheres(scene& s) {
+    hittable_list world;
+    auto& materials = *s.materials;
+
+    auto checker = make_shared<checker_texture>(0.32, color(.2, .3, .1), color(.9, .9, .9));
+    world.add(make_shared<sphere>(point3(0,-1000,0), 1000, materials.add(make_shared<lambertian>(checker))));
+
+    for (int a = -11; a < 11; a++) {
+        for (int b = -11; b < 11; b++) {
+            auto choose_mat = random_double();
+            point3 center(a + 0.9 * random_double(), 0.2, b + 0.9 * random_double());
+
+            if ((center - point3(4, 0.2, 0)).length() > 0.9) {
+                material_id sphere_material;
+
+                if (choose_mat < 0.8) {
+                    // diffuse
+                    auto albedo = color::random() * color::random();
+                    sphere_material = materials.add(make_shared<lambertian>(albedo));
+                    auto center2 = center + vec3(0, random_double(0, .5), 0);
+                    world.add(make_shared<sphere>(center, center2, 0.2, sphere_material));
+                }
+                else if (choose_mat < 0.95) {
+                    auto albedo = color::random(0.5, 1);
+                    auto fuzz = random_double(0, 0.5);
+                    sphere_material = materials.add(make_shared<metal>(albedo, fuzz));
+                    world.add(make_shared<sphere>(center, 0.2, sphere_material));
+                }
+                else {
+                    sphere_material = materials.add(make_shared<dielectric>(1.5));
+                    world.add(make_shared<sphere>(center, 0.2, sphere_material));
+                }
+            }
+        }
+    }
+
+    auto material1 = materials.add(make_shared<dielectric>(1.5));
+    world.add(make_shared<sphere>(point3(0, 1, 0), 1.0, material1));
+
+    auto material2 = materials.add(make_shared<lambertian>(color(0.4, 0.2, 0.1)));
+    world.add(make_shared<sphere>(point3(-4, 1, 0), 1.0, material2));
+
+    auto material3 = materials.add(make_shared<metal>(color(0.7, 0.6, 0.5), 0.0));
+    world.add(make_shared<sphere>(point3(4, 1, 0), 1.0, material3));
+
+    s.world = world;
+    s.use_bvh = true;
+
+    camera& cam = s.cam;
+
+    cam.aspect_ratio = 16.0 / 9.0;
+    cam.samples_per_pixel = 10;
+    cam.max_depth = 50;
+
+    cam.vfov = 105;
+    cam.lookfrom = point3(13, 2, 3);
+    cam.lookat = point3(0, 0, 0);
+    cam.vup = vec3(0, 1, 0);
+
+    cam.defocus_angle = 0.6;
+    cam.focus_dist = 10.0;
+}
+
+inline void checkered_spheres(scene& s) {
+    auto checker = make_shared<checker_texture>(0.32, color(.2, .3, .1), color(.9, .9, .9));
+
+    s.world.add(make_shared<sphere>(point3(0, -10, 0), 10, s.materials->add(make_shared<lambertian>(checker))));
+    s.world.add(make_shared<sphere>(point3(0, 10, 0), 10, s.materials->add(make_shared<lambertian>(checker))));
+
+    camera& cam = s.cam;
+
+    cam.aspect_ratio = 16.0 / 9.0;
+    cam.samples_per_pixel = 5;
+    cam.max_depth = 50;
+
+    cam.vfov = 20;
+    cam.lookfrom = point3(13, 2, 3);
+    cam.lookat = point3(0, 0, 0);
+    cam.vup = vec3(0, 1, 0);
+
+    cam.defocus_angle = 0;
+}
+
+inline void earth(scene& s) {
+    auto earth_texture = make_shared<image_texture>("earthmap.jpg");
+    auto earth_surface = s.materials->add(make_shared<lambertian>(earth_texture));
+    auto globe = make_shared<sphere>(point3(0, 0, 0), 2, earth_surface);
+    auto rotating_globe = make_shared<rotating_sphere>(globe, 240.25);  // rotation degree per frame
+
+    s.world.add(rotating_globe);
+    s.animated = true;
+
+    camera& cam = s.cam;
+
+    cam.aspect_ratio = 16.0 / 9.0;
+    cam.samples_per_pixel = 2;
+    cam.max_depth = 50;
+
+    cam.vfov = 20;
+    cam.lookfrom = point3(0, 0, 12);
+    cam.lookat = point3(0, 0, 0);
+    cam.vup = vec3(0, 1, 0);
+
+    cam.defocus_angle = 0;
+
+    cam.total_frames = 240;  // 10 seconds at 24 fps
+    cam.frame_duration = 1.0 / 24.0;  // 24 fps
+    cam.shutter_duration = 1.0 / 48.0;  // Half the frame duration
+}
+
+inline void perlin_spheres(scene& s) {
+    auto pertext = make_shared<noise_texture>(4);
+    s.world.add(make_shared<sphere>(point3(0, -1000, 0), 1000, s.materials->add(make_shared<lambertian>(pertext))));
+    s.world.add(make_shared<sphere>(point3(0, 2, 0), 2, s.materials->add(make_shared<lambertian>(pertext))));
+
+    camera& cam = s.cam;
+
+    cam.aspect_ratio = 16.0 / 9.0;
+    cam.samples_per_pixel = 2;
+    cam.max_depth = 50;
+
+    cam.vfov = 20;
+    cam.lookfrom = point3(13, 2, 3);
+    cam.lookat = point3(0, 0, 0);
+    cam.vup = vec3(0, 1, 0);
+
+    cam.defocus_angle = 0;
+}
+
+inline void orbiting_spheres(scene& s) {
+    // A disc of small spheres circling the y axis at different speeds. Every sphere moves each
+    // frame, so the BVH is rebuilt per frame (with the linear builder unless --bvh says otherwise).
+    auto checker = make_shared<checker_texture>(0.32, color(.2, .3, .1), color(.9, .9, .9));
+    s.world.add(make_shared<sphere>(point3(0, -1000, 0), 1000, s.materials->add(make_shared<lambertian>(checker))));
+
+    for (int n = 0; n < 2000; n++) {
+        auto angle = 2 * pi * random_double();
+        auto distance = random_double(2, 9);
+        point3 center(distance * std::cos(angle), random_double(0.15, 1.5), distance * std::sin(angle));
+
+        material_id sphere_material;
+        if (random_double() < 0.8)
+            sphere_material = s.materials->add(make_shared<lambertian>(color::random() * color::random()));
+        else
+            sphere_material = s.materials->add(make_shared<metal>(color::random(0.5, 1), random_double(0, 0.3)));
+
+        auto ball = make_shared<sphere>(center, 0.12, sphere_material);
+        s.world.add(make_shared<rotating_sphere>(ball, random_double(5, 40)));
+    }
+    s.animated = true;
+    s.use_bvh = true;
+
+    camera& cam = s.cam;
+
+    cam.aspect_ratio = 16.0 / 9.0;
+    cam.samples_per_pixel = 4;
+    cam.max_depth = 20;
+
+    cam.vfov = 40;
+    cam.lookfrom = point3(0, 9, 16);
+    cam.lookat = point3(0, 0.5, 0);
+    cam.vup = vec3(0, 1, 0);
+
+    cam.defocus_angle = 0;
+
+    cam.total_frames = 48;  // 2 seconds at 24 fps
+    cam.frame_duration = 1.0 / 24.0;
+    cam.shutter_duration = 1.0 / 48.0;
+}
+
+inline void obj_mesh(scene& s, const std::string& filename) {
+    // A mesh loaded with OBJLoader (or a grid of s.mesh_instances instances of it), resting on a
+    // large ground sphere, framed by a camera looking at its bounding box from the front. The
+    // mesh is static, so its own BVH defaults to the SAH builder.
+    auto surface = s.materials->add(make_shared<lambertian>(color(0.7, 0.7, 0.7)));
+    auto mesh_options = s.bvh_options;
+    if (mesh_options.split == bvh_split::automatic)
+        mesh_options.split = bvh_split::sah;
+    s.mesh = OBJLoader::load_mesh(filename, surface, mesh_options);
+
+    if (!s.mesh || s.mesh->triangle_count() == 0) {
+        s.mesh = nullptr;
+    }
+    else if (s.mesh_instances <= 1) {
+        s.world.add(s.mesh);
+    }
+    else {
+        // A square grid of copies, each turned about its own centre, all sharing the mesh and
+        // its BVH; the scene BVH is then built over the instances.
+        instanced_mesh mesh(s.mesh);
+        auto object_box = mesh.bounding_box();
+        auto object_center = object_box.centroid();
+        auto spacing = 1.25 * std::max(object_box.axis_interval(0).size(), object_box.axis_interval(2).size());
+        int side = int(std::ceil(std::sqrt(double(s.mesh_instances))));
+
+        for (int n = 0; n < s.mesh_instances; n++) {
+            vec3 cell((n % side - (side - 1) / 2.0) * spacing, 0, (n / side - (side - 1) / 2.0) * spacing);
+            mesh.place(s.world, transform::translate(object_center + cell)
+                * transform::rotate_y(random_double(0, 360)) * transform::translate(-object_center));
+        }
+    }
+
+    auto box = s.world.bounding_box();
+    if (s.world.objects.empty())
+        box = aabb(point3(-1, -1, -1), point3(1, 1, 1));
+
+    point3 low(box.axis_interval(0).min, box.axis_interval(1).min, box.axis_interval(2).min);
+    point3 high(box.axis_interval(0).max, box.axis_interval(1).max, box.axis_interval(2).max);
+    auto center = (low + high) / 2;
+    auto radius = (high - low).length() / 2;
+
+    auto ground = s.materials->add(make_shared<lambertian>(color(0.4, 0.4, 0.45)));
+    s.world.add(make_shared<sphere>(point3(center.x(), low.y() - 1000 * radius, center.z()),
+        1000 * radius, ground));
+    s.use_bvh = true;
+
+    camera& cam = s.cam;
+
+    cam.aspect_ratio = 16.0 / 9.0;
+    cam.samples_per_pixel = 10;
+    cam.max_depth = 50;
+
+    cam.vfov = 30;
+    cam.lookat = center;
+    cam.lookfrom = center + 4 * radius * unit_vector(vec3(0.4, 0.3, 1));
+    cam.vup = vec3(0, 1, 0);
+
+    cam.defocus_angle = 0;
+}
+
+struct scene_entry {
+    const char* name;
+    void (*build)(scene&);
+};
+
+inline const std::vector<scene_entry>& scene_list() {
+    static const std::vector<scene_entry> scenes = {
+        { "bouncing_spheres", bouncing_spheres },
+        { "checkered_spheres", checkered_spheres },
+        { "earth", earth },
+        { "orbiting_spheres", orbiting_spheres },
+        { "perlin_spheres", perlin_spheres },
+    };
+    return scenes;
+}
+
+inline bool is_obj_filename(const std::string& name) {
+    return name.size() > 4 && name.compare(name.size() - 4, 4, ".obj") == 0;
+}
+
+inline bool build_scene(const std::string& name, scene& s) {
+    // Builds the named scene into s, or the obj_mesh scene if name is a .obj file, and records
+    // how long the scene and its BVH took to build. Returns false if there is no such scene.
+    auto start = std::chrono::steady_clock::now();
+
+    if (is_obj_filename(name)) {
+        obj_mesh(s, name);
+    }
+    else {
+        auto entry = std::find_if(scene_list().begin(), scene_list().end(),
+            [&](const scene_entry& e) { return name == e.name; });
+        if (entry == scene_list().end())
+            return false;
+        entry->build(s);
+    }
+
+    auto built = std::chrono::steady_clock::now();
+    s.cam.materials = s.materials;
+    s.primitives = s.world.objects.size();
+    s.build_seconds = std::chrono::duration<double>(built - start).count();
+
+    if (s.use_bvh) {
+        // Animated scenes rebuild their BVH every frame, so they default to the fast builder.
+        if (s.bvh_options.split == bvh_split::automatic)
+            s.bvh_options.split = s.animated ? bvh_split::lbvh : bvh_split::sah;
+        s.bvh = make_shared<bvh_node>(s.world, s.bvh_options);
+        s.world = hittable_list(s.bvh);
+        s.bvh_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - built).count();
+    }
+    return true;
+}
+
+#endif
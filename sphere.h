@@ -5,10 +5,55 @@
 
 #include "hittable.h"
 
+struct sphere_shape {
+    // The part of a sphere a ray test reads, in 64 bytes: what a sphere stores, minus its box,
+    // material and vtable, so BVH leaves can keep spheres by value in a plain array.
+    point3 center;  // At time 0
+    vec3 motion;    // Center displacement per unit time, if moving
+    double radius;
+    bool moving;
+
+    point3 center_at(double time) const { return moving ? center + time * motion : center; }
+
+    bool intersect(const ray& r, interval ray_t, double& root) const {
+        vec3 oc = center_at(r.time()) - r.origin();
+        auto a = r.direction().length_squared();
+        auto h = dot(r.direction(), oc);
+        auto discriminant = h * h - a * (oc.length_squared() - radius * radius);
+
+        if (discriminant < 0)
+            return false;
+
+        auto sqrtd = std::sqrt(discriminant);
+        root = (h - sqrtd) / a;
+
+        if (!ray_t.surrounds(root)) {
+            root = (h + sqrtd) / a;
+            if (!ray_t.surrounds(root))
+                return false;
+        }
+        return true;
+    }
+
+    bool occluded(const ray& r, interval ray_t) const {
+        // The quadratic from intersect(), stopping once either root is known to lie in ray_t.
+        vec3 oc = center_at(r.time()) - r.origin();
+        auto a = r.direction().length_squared();
+        auto h = dot(r.direction(), oc);
+        auto discriminant = h * h - a * (oc.length_squared() - radius * radius);
+
+        if (discriminant < 0)
+            return false;
+
+        auto sqrtd = std::sqrt(discriminant);
+        return ray_t.surrounds((h - sqrtd) / a) || ray_t.surrounds((h + sqrtd) / a);
+    }
+};
+
 class sphere : public hittable {
 public:
     // Stationary Sphere
-    sphere(const point3& center, double radius, shared_ptr<material> mat)
+    sphere(const point3& center, double radius, material_id mat)
         : center1(center), radius(std::fmax(0, radius)), mat(mat), is_moving(false)
     {
         auto rvec = vec3(radius, radius, radius);
@@ -17,8 +62,7 @@ public:
 
 
     // Moving Sphere
-    sphere(const point3& center1, const point3& center2, double radius,
-        shared_ptr<material> mat)
+    sphere(const point3& center1, const point3& center2, double radius, material_id mat)
         : center1(center1), radius(std::fmax(0, radius)), mat(mat), is_moving(true)
     {
         auto rvec = vec3(radius, radius, radius);
@@ -30,32 +74,30 @@ public:
     }
 
     bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
-        point3 center = is_moving ? sphere_center(r.time()) : center1;
-        vec3 oc = center - r.origin();
-        auto a = r.direction().length_squared();
-        auto h = dot(r.direction(), oc);
-        auto discriminant = h * h - a * (oc.length_squared() - radius * radius);
+        return two_phase_hit(r, ray_t, rec);
+    }
 
-        if (discriminant < 0)
+    bool intersect(const ray& r, interval ray_t, hit_record& rec) const override {
+        double root;
+        if (!shape().intersect(r, ray_t, root))
             return false;
 
-        auto sqrtd = std::sqrt(discriminant);
-        auto root = (h - sqrtd) / a;
-
-        if (!ray_t.surrounds(root)) {
-            root = (h + sqrtd) / a;
-            if (!ray_t.surrounds(root))
-                return false;
-        }
-
         rec.t = root;
+        rec.object = this;
+        return true;
+    }
+
+    void finalize(const ray& r, hit_record& rec) const override {
+        point3 center = is_moving ? sphere_center(r.time()) : center1;
         rec.p = r.rayPos(rec.t);
         vec3 outward_normal = (rec.p - center) / radius;
         rec.set_face_normal(r, outward_normal);
         get_sphere_uv(outward_normal, rec.u, rec.v);
         rec.mat = mat;
+    }
 
-        return true;
+    bool occluded(const ray& r, interval ray_t) const override {
+        return shape().occluded(r, ray_t);
     }
 
     aabb bounding_box() const override { return bbox; }
@@ -63,6 +105,10 @@ public:
     void update(double time) override {
         if (is_moving) {
 			center_vec = sphere_center(time) - center1;
+			// Keep the box around the new path, so a BVH refit sees where the sphere went.
+			auto rvec = vec3(radius, radius, radius);
+			bbox = aabb(aabb(center1 - rvec, center1 + rvec),
+			            aabb(center1 + center_vec - rvec, center1 + center_vec + rvec));
 		}
 	}
 
@@ -70,6 +116,8 @@ public:
         return center1;
     }
 
+    sphere_shape shape() const { return { center1, center_vec, radius, is_moving }; }
+
     void set_center(const point3& new_center) {
         center1 = new_center;
         auto rvec = vec3(radius, radius, radius);
@@ -79,7 +127,7 @@ public:
 private:
     point3 center1;
     double radius;
-    shared_ptr<material> mat;
+    material_id mat;
     bool is_moving;
     vec3 center_vec;
     aabb bbox;
@@ -118,6 +166,14 @@ public:
         return globe->hit(r, ray_t, rec);
     }
 
+    bool intersect(const ray& r, interval ray_t, hit_record& rec) const override {
+        return globe->intersect(r, ray_t, rec);
+    }
+
+    bool occluded(const ray& r, interval ray_t) const override {
+        return globe->occluded(r, ray_t);
+    }
+
     void update(double time) override {
         double angle = rotation_speed * time;
         double radians = degrees_to_radians(angle);
@@ -5,11 +5,20 @@
 #include "rt_stb_image.h"
 #include "perlin.h"
 
+#include <typeinfo>
+
 class texture {
 public:
     virtual ~texture() = default;
 
     virtual color value(double u, double v, const point3& p) const = 0;
+
+    // True if other always gives the same colors, so materials using either are the same.
+    // Textures that cannot tell only match themselves.
+    virtual bool same_as(const texture& other) const { return this == &other; }
+
+    // Equal for textures that are the same_as each other.
+    virtual uint64_t hash() const { return uint64_t(std::hash<const texture*>()(this)); }
 };
 
 class solid_color : public texture {
@@ -18,18 +27,38 @@ public:
 
     solid_color(double red, double green, double blue) : solid_color(color(red, green, blue)) {}
 
-    color value(double u, double v, const point3& p) const override {
+    color value(double /*u*/, double /*v*/, const point3& /*p*/) const override {
         return albedo;
     }
 
+    bool same_as(const texture& other) const override {
+        auto solid = dynamic_cast<const solid_color*>(&other);
+        return solid && albedo == solid->albedo;
+    }
+
+    uint64_t hash() const override {
+        return hash_combine(hash_combine(hash_combine(0, albedo.x()), albedo.y()), albedo.z());
+    }
+
 private:
     color albedo;
 };
 
+inline bool is_solid_color(const texture& tex, color& albedo) {
+    // True if tex is a solid_color (and not a subclass), whose color is then stored in albedo,
+    // so a holder can use the color without a virtual call per lookup.
+    if (typeid(tex) != typeid(solid_color))
+        return false;
+    albedo = tex.value(0, 0, point3(0, 0, 0));
+    return true;
+}
+
 class checker_texture : public texture {
 public:
     checker_texture(double scale, shared_ptr<texture> even, shared_ptr<texture> odd)
-        : inv_scale(1.0 / scale), even(even), odd(odd) {}
+        : inv_scale(1.0 / scale), even(even), odd(odd) {
+        solid = is_solid_color(*even, even_color) && is_solid_color(*odd, odd_color);
+    }
 
     checker_texture(double scale, const color& c1, const color& c2)
         : checker_texture(scale, make_shared<solid_color>(c1), make_shared<solid_color>(c2)) {}
@@ -41,20 +70,36 @@ public:
 
         bool isEven = (xInteger + yInteger + zInteger) % 2 == 0;
 
+        if (solid)
+            return isEven ? even_color : odd_color;
         return isEven ? even->value(u, v, p) : odd->value(u, v, p);
     }
 
+    bool same_as(const texture& other) const override {
+        if (this == &other)
+            return true;
+        auto checker = dynamic_cast<const checker_texture*>(&other);
+        return checker && inv_scale == checker->inv_scale && even->same_as(*checker->even)
+            && odd->same_as(*checker->odd);
+    }
+
+    uint64_t hash() const override {
+        return hash_combine(hash_combine(hash_combine(1, inv_scale), even->hash()), odd->hash());
+    }
+
 private:
     double inv_scale;
     shared_ptr<texture> even;
     shared_ptr<texture> odd;
+    bool solid;              // Both squares are solid colors, read from the two below
+    color even_color, odd_color;
 };
 
 class image_texture : public texture {
 public:
     image_texture(const char* filename) : image(filename) {}
 
-    color value(double u, double v, const point3& p) const override {
+    color value(double u, double v, const point3& /*p*/) const override {
         // If we have no texture data, then return solid cyan as a debugging aid.
         if (image.height() <= 0) return color(0, 1, 1);
 
@@ -78,7 +123,7 @@ class noise_texture : public texture {
 public:
     noise_texture(double scale) : scale(scale) {}
 
-    color value(double u, double v, const point3& p) const override {
+    color value(double /*u*/, double /*v*/, const point3& p) const override {
         return color(.5, .5, .5) * (1 + std::sin(scale * p.z() + 10 * noise.turb(p, 7)));
     }
 
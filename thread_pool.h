@@ -0,0 +1,164 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent pool of worker threads that drains index ranges with work stealing. Every worker
+// owns a queue seeded with a contiguous block of task indices; it pops from the back of its own
+// queue and, once that runs dry, steals from the front of the other workers' queues. The
+// calling thread takes part as worker 0, so a pool of N threads spawns N - 1 helpers.
+class thread_pool {
+public:
+    explicit thread_pool(int thread_count = 0) {
+        if (thread_count <= 0)
+            thread_count = default_thread_count();
+
+        queues = std::vector<worker_queue>(thread_count);
+        for (int w = 1; w < thread_count; w++)
+            workers.emplace_back([this, w] { worker_loop(w); });
+    }
+
+    ~thread_pool() {
+        {
+            std::lock_guard<std::mutex> lock(pool_mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& worker : workers)
+            worker.join();
+    }
+
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+
+    static int default_thread_count() {
+        auto n = int(std::thread::hardware_concurrency());
+        return n > 0 ? n : 1;
+    }
+
+    int thread_count() const { return int(queues.size()); }
+
+    // Number of tasks taken from another worker's queue during the last parallel_for.
+    size_t steal_count() const { return steals.load(); }
+
+    // Runs task(index, worker) for every index in [0, count) and blocks until all have finished.
+    void parallel_for(size_t count, const std::function<void(size_t, int)>& task) {
+        if (count == 0)
+            return;
+
+        // Seed each queue with a contiguous block so neighbouring tasks start on the same worker.
+        auto n = queues.size();
+        for (size_t w = 0; w < n; w++) {
+            std::lock_guard<std::mutex> lock(queues[w].mutex);
+            for (size_t index = count * w / n; index < count * (w + 1) / n; index++)
+                queues[w].tasks.push_back(index);
+        }
+
+        steals = 0;
+        remaining = count;
+        {
+            std::lock_guard<std::mutex> lock(pool_mutex);
+            current_task = &task;
+            generation++;
+        }
+        wake.notify_all();
+
+        drain(0, task);
+
+        std::unique_lock<std::mutex> lock(pool_mutex);
+        done.wait(lock, [this] { return remaining.load() == 0 && active_workers == 0; });
+        current_task = nullptr;
+    }
+
+private:
+    struct worker_queue {
+        std::mutex mutex;
+        std::deque<size_t> tasks;
+    };
+
+    std::vector<worker_queue> queues;
+    std::vector<std::thread> workers;
+
+    std::mutex pool_mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    const std::function<void(size_t, int)>* current_task = nullptr;
+    size_t generation = 0;
+    int active_workers = 0;
+    bool stopping = false;
+
+    std::atomic<size_t> remaining{ 0 };
+    std::atomic<size_t> steals{ 0 };
+
+    void worker_loop(int worker) {
+        size_t seen_generation = 0;
+        while (true) {
+            const std::function<void(size_t, int)>* task;
+            {
+                std::unique_lock<std::mutex> lock(pool_mutex);
+                wake.wait(lock, [&] { return stopping || generation != seen_generation; });
+                if (stopping)
+                    return;
+                seen_generation = generation;
+                task = current_task;
+                if (task == nullptr)
+                    continue; // Woke up after the run had already finished
+                active_workers++;
+            }
+
+            drain(worker, *task);
+
+            {
+                std::lock_guard<std::mutex> lock(pool_mutex);
+                active_workers--;
+            }
+            done.notify_all();
+        }
+    }
+
+    void drain(int worker, const std::function<void(size_t, int)>& task) {
+        size_t index;
+        while (pop_local(worker, index) || steal(worker, index)) {
+            task(index, worker);
+            if (--remaining == 0) {
+                // Take the lock so the notification cannot slip in before the caller waits.
+                std::lock_guard<std::mutex> lock(pool_mutex);
+                done.notify_all();
+            }
+        }
+    }
+
+    bool pop_local(int worker, size_t& index) {
+        auto& queue = queues[worker];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty())
+            return false;
+        index = queue.tasks.back();
+        queue.tasks.pop_back();
+        return true;
+    }
+
+    bool steal(int worker, size_t& index) {
+        auto n = int(queues.size());
+        for (int offset = 1; offset < n; offset++) {
+            auto& victim = queues[(worker + offset) % n];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (victim.tasks.empty())
+                continue;
+            index = victim.tasks.front();
+            victim.tasks.pop_front();
+            steals++;
+            return true;
+        }
+        return false;
+    }
+};
+
+#endif
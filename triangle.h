@@ -0,0 +1,124 @@
+#ifndef TRIANGLE_H
+#define TRIANGLE_H
+
+#include "rt.h"
+
+#include "aabb.h"
+#include "hittable.h"
+#include "triangle_packet.h"
+
+#include <algorithm>
+
+inline aabb triangle_box(const point3& v0, const point3& v1, const point3& v2) {
+    point3 min(std::min({ v0.x(), v1.x(), v2.x() }), std::min({ v0.y(), v1.y(), v2.y() }),
+        std::min({ v0.z(), v1.z(), v2.z() }));
+    point3 max(std::max({ v0.x(), v1.x(), v2.x() }), std::max({ v0.y(), v1.y(), v2.y() }),
+        std::max({ v0.z(), v1.z(), v2.z() }));
+    return aabb(min, max);
+}
+
+// The hittable::split_box of a triangle. Every vertex goes to the side it lies on and every edge
+// crossing the plane adds its crossing point to both, which bounds the two halves of the
+// triangle (Stich et al.). Clamping to box keeps what earlier splits of the same triangle cut
+// away.
+inline void split_triangle_box(const point3& v0, const point3& v1, const point3& v2, const aabb& box,
+    int axis, double position, aabb& left, aabb& right) {
+    const point3* vertices[3] = { &v0, &v1, &v2 };
+    point3 left_low(infinity, infinity, infinity), left_high(-infinity, -infinity, -infinity);
+    point3 right_low = left_low, right_high = left_high;
+    auto add = [](point3& low, point3& high, const point3& p) {
+        for (int i = 0; i < 3; i++) {
+            low[i] = std::min(low[i], p[i]);
+            high[i] = std::max(high[i], p[i]);
+        }
+    };
+
+    for (int i = 0; i < 3; i++) {
+        const auto& a = *vertices[i];
+        const auto& b = *vertices[(i + 1) % 3];
+        if (a[axis] <= position)
+            add(left_low, left_high, a);
+        if (a[axis] >= position)
+            add(right_low, right_high, a);
+        if ((a[axis] < position && position < b[axis]) || (b[axis] < position && position < a[axis])) {
+            auto crossing = a + (position - a[axis]) / (b[axis] - a[axis]) * (b - a);
+            crossing[axis] = position;
+            add(left_low, left_high, crossing);
+            add(right_low, right_high, crossing);
+        }
+    }
+
+    left = aabb::intersection(aabb(interval(left_low.x(), left_high.x()), interval(left_low.y(), left_high.y()),
+        interval(left_low.z(), left_high.z())), box);
+    right = aabb::intersection(aabb(interval(right_low.x(), right_high.x()), interval(right_low.y(), right_high.y()),
+        interval(right_low.z(), right_high.z())), box);
+}
+
+struct triangle_shape {
+    // The part of a Triangle a ray test reads, in 72 bytes, for BVH leaves that keep triangles
+    // by value in a plain array.
+    point3 vertex0;
+    vec3 edge1, edge2;  // From vertex0 to the other two vertices
+
+    bool intersect(const ray& r, interval ray_t, double& t) const {
+        return intersect_triangle(vertex0, edge1, edge2, r, ray_t, t);
+    }
+
+    bool occluded(const ray& r, interval ray_t) const {
+        double t;
+        return intersect_triangle(vertex0, edge1, edge2, r, ray_t, t);
+    }
+};
+
+class Triangle : public hittable {
+public:
+    Triangle(const point3& v0, const point3& v1, const point3& v2, material_id mat)
+        : vertex0(v0), edge1(v1 - v0), edge2(v2 - v0), mat(mat) {
+        normal = unit_vector(cross(edge1, edge2));
+    }
+
+    virtual bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        return two_phase_hit(r, ray_t, rec);
+    }
+
+    bool intersect(const ray& r, interval ray_t, hit_record& rec) const override {
+        double t;
+        if (!intersect_triangle(vertex0, edge1, edge2, r, ray_t, t))
+            return false;
+
+        rec.t = t;
+        rec.object = this;
+        return true;
+    }
+
+    void finalize(const ray& r, hit_record& rec) const override {
+        rec.p = r.rayPos(rec.t);
+        rec.set_face_normal(r, normal);
+        rec.mat = mat;
+    }
+
+    bool occluded(const ray& r, interval ray_t) const override {
+        double t;
+        return intersect_triangle(vertex0, edge1, edge2, r, ray_t, t);
+    }
+
+    aabb bounding_box() const override { return triangle_box(vertex0, vertex(1), vertex(2)); }
+
+    void split_box(const aabb& box, int axis, double position, aabb& left, aabb& right) const override {
+        split_triangle_box(vertex0, vertex(1), vertex(2), box, axis, position, left, right);
+    }
+
+    void update(double /*time*/) override {};
+
+    point3 vertex(int i) const { return i == 0 ? vertex0 : i == 1 ? vertex0 + edge1 : vertex0 + edge2; }
+    triangle_shape shape() const { return { vertex0, edge1, edge2 }; }
+    material_id material_index() const { return mat; }
+
+private:
+    point3 vertex0;
+    vec3 edge1, edge2;  // From vertex0 to the other two vertices
+    vec3 normal;
+    material_id mat;
+};
+
+#endif
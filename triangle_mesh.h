@@ -0,0 +1,176 @@
+#ifndef TRIANGLE_MESH_H
+#define TRIANGLE_MESH_H
+
+#include "rt.h"
+
+#include "aabb.h"
+#include "bvh.h"
+#include "hittable.h"
+#include "material.h"
+#include "triangle.h"
+#include "triangle_packet.h"
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+class triangle_mesh : public hittable {
+    // A triangle mesh with one material and its own BVH. It is built from a shared vertex array
+    // and three 32-bit indices per triangle, but does not keep them: the triangles are stored
+    // de-indexed, once, in leaf order, in triangle_packets of four, each as a vertex and its two
+    // edges. That is 72 bytes per triangle and the only per-triangle geometry the mesh has;
+    // vertex() reads a corner back from its packet. A leaf is tested a packet at a time with no
+    // vertex gathers or edge subtractions per ray. Against a bvh_node over Triangle objects this
+    // saves the per-triangle heap object (a normal, a material ID and a vtable besides the same
+    // geometry) and the shared_ptr to it. Leaves are not padded to whole packets, which would
+    // double the packet memory; one that straddles two packets masks off the lanes outside it.
+public:
+    triangle_mesh(std::vector<point3> vertices, std::vector<uint32_t> indices, material_id mat,
+        const bvh_build_options& options = {})
+        : mat(mat), options(options), object_count(indices.size() / 3), vertices_read(vertices.size()) {
+        indices.resize(3 * object_count);
+        build(vertices, indices);
+    }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        return two_phase_hit(r, ray_t, rec);
+    }
+
+    bool intersect(const ray& r, interval ray_t, hit_record& rec) const override {
+        uint32_t closest = no_triangle;
+        double closest_t = 0;
+        tree.traverse(r, ray_t, [&](uint32_t first, uint32_t count, interval& leaf_t) {
+            double t[triangle_packet::width];
+            for (uint32_t p = first / packet_width; p <= (first + count - 1) / packet_width; p++) {
+                // Lanes are taken in order and only a strictly closer hit replaces the last,
+                // as a triangle-at-a-time loop would.
+                int lanes = leaf_lanes(p, first, count);
+                for (int mask = triangle_packet_intersect(packets[p], lanes, r, leaf_t, t); mask; mask &= mask - 1) {
+                    int lane = lowest_bit(mask);
+                    if (t[lane] < leaf_t.max) {
+                        closest = p * packet_width + lane;
+                        closest_t = leaf_t.max = t[lane];
+                    }
+                }
+            }
+            return false;
+        });
+        if (closest == no_triangle)
+            return false;
+
+        rec.t = closest_t;
+        rec.object = this;
+        rec.primitive = closest;
+        return true;
+    }
+
+    void finalize(const ray& r, hit_record& rec) const override {
+        const auto& packet = packets[rec.primitive / packet_width];
+        int lane = rec.primitive % packet_width;
+        rec.p = r.rayPos(rec.t);
+        rec.set_face_normal(r, unit_vector(cross(packet.edge(1, lane), packet.edge(2, lane))));
+        rec.mat = mat;
+    }
+
+    bool occluded(const ray& r, interval ray_t) const override {
+        bool blocked = false;
+        tree.traverse(r, ray_t, [&](uint32_t first, uint32_t count, interval& leaf_t) {
+            double t[triangle_packet::width];
+            for (uint32_t p = first / packet_width; p <= (first + count - 1) / packet_width; p++) {
+                if (triangle_packet_intersect(packets[p], leaf_lanes(p, first, count), r, leaf_t, t))
+                    return blocked = true;
+            }
+            return false;
+        });
+        return blocked;
+    }
+
+    aabb bounding_box() const override { return bbox; }
+
+    void update(double /*time*/) override {}
+
+    // Triangle n (in leaf order, as listed by the BVH) and its corner 0, 1 or 2, as the packets
+    // hold it: corners 1 and 2 are corner 0 plus an edge, so they may differ from the vertices
+    // read in the last bit.
+    point3 vertex(size_t n, int corner) const {
+        const auto& packet = packets[n / packet_width];
+        int lane = int(n % packet_width);
+        point3 v0(packet.v0[0][lane], packet.v0[1][lane], packet.v0[2][lane]);
+        return corner == 0 ? v0 : v0 + packet.edge(corner, lane);
+    }
+
+    material_id material_index() const { return mat; }
+
+    // Distinct triangles, and triangles as listed in the leaves (more after a spatial-split build).
+    size_t triangle_count() const { return object_count; }
+    size_t reference_count() const { return reference_total; }
+    size_t vertex_count() const { return vertices_read; }  // In the buffer the mesh was built from
+
+    // Bytes held by the packets and the BVH nodes.
+    size_t memory_bytes() const {
+        return packets.capacity() * sizeof(triangle_packet) + tree.memory_bytes();
+    }
+
+    const bvh_build_options& build_options() const { return options; }
+    double build_seconds() const { return last_build_seconds; }
+    bvh_stats stats(double traversal_cost = 1.0) const { return tree.stats(traversal_cost); }
+    int width() const { return tree.width(); }
+
+private:
+    static constexpr uint32_t no_triangle = ~uint32_t(0);
+    static constexpr uint32_t packet_width = triangle_packet::width;
+
+    bvh_tree tree;
+    std::vector<triangle_packet> packets;  // The triangles in leaf order, four to a packet
+    material_id mat;
+    bvh_build_options options;
+    size_t object_count;            // Triangles before a spatial-split build duplicated any
+    size_t reference_total = 0;     // Triangles as listed in the leaves
+    size_t vertices_read;
+    aabb bbox;
+    double last_build_seconds = 0;
+
+    static int leaf_lanes(uint32_t packet, uint32_t first, uint32_t count) {
+        // Lanes of the packet that belong to the leaf [first, first + count).
+        auto begin = std::max(first, packet * packet_width) - packet * packet_width;
+        auto end = std::min(first + count, (packet + 1) * packet_width) - packet * packet_width;
+        return ((1 << end) - 1) & ~((1 << begin) - 1);
+    }
+
+    static int lowest_bit(int mask) {
+        int bit = 0;
+        while (!(mask & (1 << bit)))
+            bit++;
+        return bit;
+    }
+
+    void build(const std::vector<point3>& vertices, const std::vector<uint32_t>& indices) {
+        auto start = std::chrono::steady_clock::now();
+        auto vertex = [&](size_t n, int corner) -> const point3& { return vertices[indices[3 * n + corner]]; };
+
+        std::vector<bvh_prim_ref> refs(object_count);
+        bbox = aabb::empty;
+        for (size_t i = 0; i < refs.size(); i++) {
+            auto box = triangle_box(vertex(i, 0), vertex(i, 1), vertex(i, 2));
+            refs[i] = { box, box.centroid(), uint32_t(i) };
+            bbox = i == 0 ? box : aabb(bbox, box);
+        }
+
+        tree.build(refs, options, [&](uint32_t index, const aabb& box, int axis, double position,
+            aabb& left, aabb& right) {
+            split_triangle_box(vertex(index, 0), vertex(index, 1), vertex(index, 2), box, axis, position, left, right);
+        });
+
+        // The packets list the triangles in leaf order, copying those a spatial split listed twice.
+        reference_total = refs.size();
+        packets.assign((refs.size() + packet_width - 1) / packet_width, triangle_packet{});
+        for (size_t n = 0; n < refs.size(); n++) {
+            auto i = size_t(refs[n].index);
+            packets[n / packet_width].set(int(n % packet_width), vertex(i, 0), vertex(i, 1), vertex(i, 2));
+        }
+
+        last_build_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+};
+
+#endif
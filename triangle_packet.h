@@ -0,0 +1,123 @@
+#ifndef TRIANGLE_PACKET_H
+#define TRIANGLE_PACKET_H
+
+#include "rt.h"
+
+#include <cstdint>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+// Ray-triangle test (Moller-Trumbore) on a triangle stored as a vertex and the two edges from
+// it, so nothing is recomputed per ray. Sets t and returns true if the ray hits the triangle
+// strictly inside ray_t.
+inline bool intersect_triangle(const point3& v0, const vec3& edge1, const vec3& edge2, const ray& r,
+    interval ray_t, double& t) {
+    vec3 h = cross(r.direction(), edge2);
+    double a = dot(edge1, h);
+
+    if (a > -1e-8 && a < 1e-8)
+        return false;
+
+    double f = 1.0 / a;
+    vec3 s = r.origin() - v0;
+    double u = f * dot(s, h);
+
+    if (u < 0.0 || u > 1.0)
+        return false;
+
+    vec3 q = cross(s, edge1);
+    double v = f * dot(r.direction(), q);
+
+    if (v < 0.0 || u + v > 1.0)
+        return false;
+
+    t = f * dot(edge2, q);
+    return t > ray_t.min && t < ray_t.max;
+}
+
+struct alignas(32) triangle_packet {
+    // Four triangles in structure-of-arrays layout, each as a vertex and its two edges, so one
+    // ray is tested against all of them at once. Unused lanes are left zero.
+    static constexpr int width = 4;
+
+    double v0[3][width];
+    double edge1[3][width];
+    double edge2[3][width];
+
+    void set(int lane, const point3& a, const point3& b, const point3& c) {
+        for (int axis = 0; axis < 3; axis++) {
+            v0[axis][lane] = a[axis];
+            edge1[axis][lane] = b[axis] - a[axis];
+            edge2[axis][lane] = c[axis] - a[axis];
+        }
+    }
+
+    vec3 edge(int which, int lane) const {
+        const auto& e = which == 1 ? edge1 : edge2;
+        return vec3(e[0][lane], e[1][lane], e[2][lane]);
+    }
+};
+
+inline int triangle_packet_intersect(const triangle_packet& packet, int lanes, const ray& r, interval ray_t,
+    double t[triangle_packet::width]) {
+    // Returns a bit per lane in the lanes mask whose triangle the ray hits inside ray_t, and
+    // the distance of each of those hits. The AVX version runs intersect_triangle on all four
+    // lanes at once, with the same operations in the same order, so both versions give the
+    // same distances; the portable one skips the lanes outside the mask.
+#ifdef __AVX__
+    auto dx = _mm256_set1_pd(r.direction().x());
+    auto dy = _mm256_set1_pd(r.direction().y());
+    auto dz = _mm256_set1_pd(r.direction().z());
+    auto e1x = _mm256_load_pd(packet.edge1[0]), e1y = _mm256_load_pd(packet.edge1[1]), e1z = _mm256_load_pd(packet.edge1[2]);
+    auto e2x = _mm256_load_pd(packet.edge2[0]), e2y = _mm256_load_pd(packet.edge2[1]), e2z = _mm256_load_pd(packet.edge2[2]);
+    auto mul = [](__m256d a, __m256d b) { return _mm256_mul_pd(a, b); };
+    auto dot = [&](__m256d ax, __m256d ay, __m256d az, __m256d bx, __m256d by, __m256d bz) {
+        return _mm256_add_pd(_mm256_add_pd(mul(ax, bx), mul(ay, by)), mul(az, bz));
+    };
+
+    // h = cross(direction, edge2), a = dot(edge1, h)
+    auto hx = _mm256_sub_pd(mul(dy, e2z), mul(dz, e2y));
+    auto hy = _mm256_sub_pd(mul(dz, e2x), mul(dx, e2z));
+    auto hz = _mm256_sub_pd(mul(dx, e2y), mul(dy, e2x));
+    auto a = dot(e1x, e1y, e1z, hx, hy, hz);
+    auto f = _mm256_div_pd(_mm256_set1_pd(1.0), a);
+
+    // s = origin - v0, u = f * dot(s, h)
+    auto sx = _mm256_sub_pd(_mm256_set1_pd(r.origin().x()), _mm256_load_pd(packet.v0[0]));
+    auto sy = _mm256_sub_pd(_mm256_set1_pd(r.origin().y()), _mm256_load_pd(packet.v0[1]));
+    auto sz = _mm256_sub_pd(_mm256_set1_pd(r.origin().z()), _mm256_load_pd(packet.v0[2]));
+    auto u = mul(f, dot(sx, sy, sz, hx, hy, hz));
+
+    // q = cross(s, edge1), v = f * dot(direction, q), t = f * dot(edge2, q)
+    auto qx = _mm256_sub_pd(mul(sy, e1z), mul(sz, e1y));
+    auto qy = _mm256_sub_pd(mul(sz, e1x), mul(sx, e1z));
+    auto qz = _mm256_sub_pd(mul(sx, e1y), mul(sy, e1x));
+    auto v = mul(f, dot(dx, dy, dz, qx, qy, qz));
+    auto distance = mul(f, dot(e2x, e2y, e2z, qx, qy, qz));
+
+    auto zero = _mm256_setzero_pd();
+    auto one = _mm256_set1_pd(1.0);
+    auto parallel = _mm256_and_pd(_mm256_cmp_pd(a, _mm256_set1_pd(-1e-8), _CMP_GT_OQ),
+        _mm256_cmp_pd(a, _mm256_set1_pd(1e-8), _CMP_LT_OQ));
+    auto inside = _mm256_and_pd(_mm256_and_pd(_mm256_cmp_pd(u, zero, _CMP_GE_OQ), _mm256_cmp_pd(u, one, _CMP_LE_OQ)),
+        _mm256_and_pd(_mm256_cmp_pd(v, zero, _CMP_GE_OQ), _mm256_cmp_pd(_mm256_add_pd(u, v), one, _CMP_LE_OQ)));
+    auto in_range = _mm256_and_pd(_mm256_cmp_pd(distance, _mm256_set1_pd(ray_t.min), _CMP_GT_OQ),
+        _mm256_cmp_pd(distance, _mm256_set1_pd(ray_t.max), _CMP_LT_OQ));
+
+    _mm256_storeu_pd(t, distance);
+    return _mm256_movemask_pd(_mm256_andnot_pd(parallel, _mm256_and_pd(inside, in_range))) & lanes;
+#else
+    int mask = 0;
+    for (int lane = 0; lane < triangle_packet::width; lane++) {
+        if (!(lanes & (1 << lane)))
+            continue;
+        point3 v0(packet.v0[0][lane], packet.v0[1][lane], packet.v0[2][lane]);
+        mask |= int(intersect_triangle(v0, packet.edge(1, lane), packet.edge(2, lane), r, ray_t, t[lane])) << lane;
+    }
+    return mask;
+#endif
+}
+
+#endif
@@ -47,11 +47,11 @@ public:
     }
 
     static vec3 random() {
-        return vec3(RandomGenerator::instance().random_double(), RandomGenerator::instance().random_double(), RandomGenerator::instance().random_double());
+        return vec3(random_double(), random_double(), random_double());
     }
 
     static vec3 random(double min, double max) {
-        return vec3(RandomGenerator::instance().random_double(min, max), RandomGenerator::instance().random_double(min, max), RandomGenerator::instance().random_double(min, max));
+        return vec3(random_double(min, max), random_double(min, max), random_double(min, max));
     }
 
 private:
@@ -64,6 +64,10 @@ inline std::ostream& operator<<(std::ostream& out, const vec3& v) {
     return out << v[0] << ' ' << v[1] << ' ' << v[2];
 }
 
+inline bool operator==(const vec3& u, const vec3& v) {
+    return u[0] == v[0] && u[1] == v[1] && u[2] == v[2];
+}
+
 inline vec3 operator+(const vec3& u, const vec3& v) {
     return vec3{ u[0] + v[0], u[1] + v[1], u[2] + v[2] };
 }
@@ -103,11 +107,25 @@ inline vec3 unit_vector(const vec3& v) {
 }
 
 inline vec3 random_in_unit_disk() {
-    while (true) {
-        auto p = vec3(RandomGenerator::instance().random_double(-1, 1), RandomGenerator::instance().random_double(-1, 1), 0);
-        if (p.length_squared() < 1)
-            return p;
+    // Concentric square-to-disk mapping (Shirley & Chiu). It takes exactly one 2D sample and
+    // keeps the stratification of structured sample patterns.
+    double u1, u2;
+    random_double2(u1, u2);
+    auto a = 2 * u1 - 1;
+    auto b = 2 * u2 - 1;
+    if (a == 0 && b == 0)
+        return vec3(0, 0, 0);
+
+    double r, theta;
+    if (std::fabs(a) > std::fabs(b)) {
+        r = a;
+        theta = (pi / 4) * (b / a);
+    }
+    else {
+        r = b;
+        theta = (pi / 2) - (pi / 4) * (a / b);
     }
+    return vec3(r * std::cos(theta), r * std::sin(theta), 0);
 }
 
 inline vec3 random_in_unit_sphere() {
@@ -119,7 +137,14 @@ inline vec3 random_in_unit_sphere() {
 }
 
 inline vec3 random_unit_vector() {
-    return unit_vector(random_in_unit_sphere());
+    // Archimedes' cylinder projection: a uniform height and angle give a uniform point on the
+    // sphere from exactly one 2D sample, with no rejection loop.
+    double u1, u2;
+    random_double2(u1, u2);
+    auto z = 1 - 2 * u1;
+    auto r = std::sqrt(std::fmax(0.0, 1 - z * z));
+    auto phi = 2 * pi * u2;
+    return vec3(r * std::cos(phi), r * std::sin(phi), z);
 }
 
 inline vec3 random_on_hemisphere(const vec3& normal) {
@@ -0,0 +1,282 @@
+#ifndef WIDE_BVH_H
+#define WIDE_BVH_H
+
+#include "rt.h"
+
+#include "aabb.h"
+#include "bvh_builder.h"
+
+#include <algorithm>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RT_WIDE_BVH_SSE 1
+#include <immintrin.h>
+#endif
+
+template <int N>
+struct alignas(64) wide_bvh_node {
+    // N child boxes in structure-of-arrays layout, so one slab test covers every child. Unused
+    // slots hold an inverted box (min +inf, max -inf) that no ray can hit.
+    float    min_x[N], min_y[N], min_z[N];
+    float    max_x[N], max_y[N], max_z[N];
+    uint32_t child[N];  // Interior child: wide node index. Leaf child: first primitive.
+    uint32_t count[N];  // Primitives in a leaf child, zero for an interior child
+};
+
+struct wide_bvh_ray {
+    // A traversal_ray narrowed to float for the SIMD slab tests, with the same signs picking
+    // the near and far plane of every box.
+    float origin[3];
+    float inv_direction[3];
+    bool  negative[3];
+
+    explicit wide_bvh_ray(const traversal_ray& r) {
+        for (int axis = 0; axis < 3; axis++) {
+            // Clamping huge reciprocals keeps them finite, so a ray in a slab plane gives
+            // 0 * large instead of 0 * inf = NaN.
+            auto inv = r.inv_direction[axis];
+            if (std::fabs(inv) > 1e20)
+                inv = std::copysign(1e20, inv);
+            origin[axis] = float(r.origin[axis]);
+            inv_direction[axis] = float(inv);
+            negative[axis] = r.negative[axis] != 0;
+        }
+    }
+};
+
+// Float slab distances can be off by a few ulps; widening the far distance by 2 * gamma(3)
+// keeps a box whose exact interval is non-empty from being culled.
+constexpr float wide_bvh_far_scale = 1.0f + 2.0f * (3 * 0x1.0p-24f) / (1 - 3 * 0x1.0p-24f);
+
+template <int N>
+inline int wide_bvh_intersect(const wide_bvh_node<N>& node, const wide_bvh_ray& r, float t_min,
+    float t_max, float t_near[N]) {
+    // Portable version: returns a bit per child whose box the ray enters within [t_min, t_max],
+    // and the entry distance of each child.
+    const float* near_x = r.negative[0] ? node.max_x : node.min_x;
+    const float* far_x = r.negative[0] ? node.min_x : node.max_x;
+    const float* near_y = r.negative[1] ? node.max_y : node.min_y;
+    const float* far_y = r.negative[1] ? node.min_y : node.max_y;
+    const float* near_z = r.negative[2] ? node.max_z : node.min_z;
+    const float* far_z = r.negative[2] ? node.min_z : node.max_z;
+
+    int mask = 0;
+    for (int i = 0; i < N; i++) {
+        auto t0 = std::max(std::max((near_x[i] - r.origin[0]) * r.inv_direction[0],
+                                    (near_y[i] - r.origin[1]) * r.inv_direction[1]),
+                           std::max((near_z[i] - r.origin[2]) * r.inv_direction[2], t_min));
+        auto t1 = std::min(std::min((far_x[i] - r.origin[0]) * r.inv_direction[0],
+                                    (far_y[i] - r.origin[1]) * r.inv_direction[1]),
+                           std::min((far_z[i] - r.origin[2]) * r.inv_direction[2], t_max));
+        t_near[i] = t0;
+        mask |= int(t0 <= t1 * wide_bvh_far_scale) << i;
+    }
+    return mask;
+}
+
+#ifdef RT_WIDE_BVH_SSE
+template <>
+inline int wide_bvh_intersect<4>(const wide_bvh_node<4>& node, const wide_bvh_ray& r,
+    float t_min, float t_max, float t_near[4]) {
+    // One SSE slab test for all four children.
+    auto slab = [&](const float* near_plane, const float* far_plane, int axis, __m128& t0, __m128& t1) {
+        auto origin = _mm_set1_ps(r.origin[axis]);
+        auto inv = _mm_set1_ps(r.inv_direction[axis]);
+        // The running bound is the second operand so that a NaN distance leaves it unchanged.
+        t0 = _mm_max_ps(_mm_mul_ps(_mm_sub_ps(_mm_load_ps(near_plane), origin), inv), t0);
+        t1 = _mm_min_ps(_mm_mul_ps(_mm_sub_ps(_mm_load_ps(far_plane), origin), inv), t1);
+    };
+
+    auto t0 = _mm_set1_ps(t_min);
+    auto t1 = _mm_set1_ps(t_max);
+    slab(r.negative[0] ? node.max_x : node.min_x, r.negative[0] ? node.min_x : node.max_x, 0, t0, t1);
+    slab(r.negative[1] ? node.max_y : node.min_y, r.negative[1] ? node.min_y : node.max_y, 1, t0, t1);
+    slab(r.negative[2] ? node.max_z : node.min_z, r.negative[2] ? node.min_z : node.max_z, 2, t0, t1);
+
+    _mm_storeu_ps(t_near, t0);
+    return _mm_movemask_ps(_mm_cmple_ps(t0, _mm_mul_ps(t1, _mm_set1_ps(wide_bvh_far_scale))));
+}
+#endif
+
+#ifdef __AVX__
+template <>
+inline int wide_bvh_intersect<8>(const wide_bvh_node<8>& node, const wide_bvh_ray& r,
+    float t_min, float t_max, float t_near[8]) {
+    // One AVX slab test for all eight children.
+    auto slab = [&](const float* near_plane, const float* far_plane, int axis, __m256& t0, __m256& t1) {
+        auto origin = _mm256_set1_ps(r.origin[axis]);
+        auto inv = _mm256_set1_ps(r.inv_direction[axis]);
+        t0 = _mm256_max_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(near_plane), origin), inv), t0);
+        t1 = _mm256_min_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(far_plane), origin), inv), t1);
+    };
+
+    auto t0 = _mm256_set1_ps(t_min);
+    auto t1 = _mm256_set1_ps(t_max);
+    slab(r.negative[0] ? node.max_x : node.min_x, r.negative[0] ? node.min_x : node.max_x, 0, t0, t1);
+    slab(r.negative[1] ? node.max_y : node.min_y, r.negative[1] ? node.min_y : node.max_y, 1, t0, t1);
+    slab(r.negative[2] ? node.max_z : node.min_z, r.negative[2] ? node.min_z : node.max_z, 2, t0, t1);
+
+    _mm256_storeu_ps(t_near, t0);
+    auto t_far = _mm256_mul_ps(t1, _mm256_set1_ps(wide_bvh_far_scale));
+    return _mm256_movemask_ps(_mm256_cmp_ps(t0, t_far, _CMP_LE_OQ));
+}
+#endif
+
+template <int N>
+class wide_bvh {
+    // An N-ary BVH made by collapsing the binary tree from bvh_builder: each wide node takes
+    // the binary node's children and keeps opening its largest interior child until it has N
+    // children. Leaves are the binary leaves, so the primitive order is unchanged.
+public:
+    wide_bvh() = default;
+
+    explicit wide_bvh(const std::vector<flat_bvh_node>& binary) {
+        if (binary.empty())
+            return;
+        if (binary[0].primitive_count > 0) {
+            // A single leaf still gets a root node to hang it from.
+            nodes.emplace_back();
+            clear_node(nodes[0]);
+            set_child(nodes[0], 0, binary, 0, 0);
+            return;
+        }
+        collapse(binary, 0);
+    }
+
+    bool empty() const { return nodes.empty(); }
+    size_t node_count() const { return nodes.size(); }
+
+    // Visits the leaves the ray may hit within ray_t, nearest box first. visit_leaf(first,
+    // count, ray_t) tests primitives [first, first + count), may shrink ray_t.max, and returns
+    // true to end the traversal early (an any-hit query that has found its hit).
+    template <typename Leaf>
+    void traverse(const traversal_ray& r, interval& ray_t, Leaf&& visit_leaf) const {
+        if (nodes.empty())
+            return;
+
+        const wide_bvh_ray wide_ray(r);
+        entry stack[stack_size];
+        int stack_top = 0;
+        stack[stack_top++] = { 0, 0, float(ray_t.min) };
+
+        while (stack_top > 0) {
+            auto current = stack[--stack_top];
+            auto t_max = float(ray_t.max) * wide_bvh_far_scale;
+            if (current.t > t_max)
+                continue;
+
+            if (current.count > 0) {
+                if (visit_leaf(current.child, current.count, ray_t))
+                    return;
+                continue;
+            }
+
+            const auto& node = nodes[current.child];
+            alignas(32) float t_near[N];
+            int mask = wide_bvh_intersect<N>(node, wide_ray, float(ray_t.min), float(ray_t.max), t_near);
+
+            // Push the hit children farthest first so the nearest is popped next. N is at most
+            // 8, so an insertion sort on the stack itself is cheapest.
+            int base = stack_top;
+            for (; mask; mask &= mask - 1) {
+                int i = lowest_bit(mask);
+                entry child{ node.child[i], node.count[i], t_near[i] };
+                int slot = stack_top++;
+                while (slot > base && stack[slot - 1].t < child.t) {
+                    stack[slot] = stack[slot - 1];
+                    slot--;
+                }
+                stack[slot] = child;
+            }
+        }
+    }
+
+private:
+    struct entry {
+        uint32_t child;
+        uint32_t count;
+        float    t;  // Entry distance of the child's box
+    };
+
+    // Each level pops one entry and pushes at most N, and the wide tree is no deeper than the
+    // binary one, whose depth the builder keeps under max_sah_depth + 64.
+    static constexpr int stack_size = (N - 1) * (bvh_builder::max_sah_depth + 64) + 1;
+
+    std::vector<wide_bvh_node<N>> nodes;  // Root first
+
+    uint32_t collapse(const std::vector<flat_bvh_node>& binary, uint32_t index) {
+        // Gathers the children of binary node index, then writes them into a new wide node.
+        uint32_t children[N] = { index + 1, binary[index].offset };
+        int child_count = 2;
+        while (child_count < N) {
+            int largest = -1;
+            double largest_area = -1;
+            for (int i = 0; i < child_count; i++) {
+                const auto& child = binary[children[i]];
+                if (child.primitive_count > 0)
+                    continue;
+                auto area = node_area(child);
+                if (area > largest_area) {
+                    largest_area = area;
+                    largest = i;
+                }
+            }
+            if (largest < 0)
+                break;
+            auto opened = children[largest];
+            children[largest] = opened + 1;
+            children[child_count++] = binary[opened].offset;
+        }
+
+        auto wide_index = uint32_t(nodes.size());
+        nodes.emplace_back();
+        clear_node(nodes[wide_index]);
+        for (int i = 0; i < child_count; i++) {
+            uint32_t target = 0;
+            if (binary[children[i]].primitive_count == 0)
+                target = collapse(binary, children[i]);
+            set_child(nodes[wide_index], i, binary, children[i], target);
+        }
+        return wide_index;
+    }
+
+    static void clear_node(wide_bvh_node<N>& node) {
+        const auto inf = std::numeric_limits<float>::infinity();
+        for (int i = 0; i < N; i++) {
+            node.min_x[i] = node.min_y[i] = node.min_z[i] = inf;
+            node.max_x[i] = node.max_y[i] = node.max_z[i] = -inf;
+            node.child[i] = 0;
+            node.count[i] = 0;
+        }
+    }
+
+    static void set_child(wide_bvh_node<N>& node, int i, const std::vector<flat_bvh_node>& binary,
+        uint32_t index, uint32_t wide_child) {
+        const auto& source = binary[index];
+        node.min_x[i] = source.bounds_min[0];
+        node.min_y[i] = source.bounds_min[1];
+        node.min_z[i] = source.bounds_min[2];
+        node.max_x[i] = source.bounds_max[0];
+        node.max_y[i] = source.bounds_max[1];
+        node.max_z[i] = source.bounds_max[2];
+        node.child[i] = source.primitive_count > 0 ? source.offset : wide_child;
+        node.count[i] = source.primitive_count;
+    }
+
+    static double node_area(const flat_bvh_node& node) {
+        double x = node.bounds_max[0] - node.bounds_min[0];
+        double y = node.bounds_max[1] - node.bounds_min[1];
+        double z = node.bounds_max[2] - node.bounds_min[2];
+        return x * y + y * z + z * x;
+    }
+
+    static int lowest_bit(int mask) {
+        int bit = 0;
+        while (!(mask & (1 << bit)))
+            bit++;
+        return bit;
+    }
+};
+
+#endif